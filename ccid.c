@@ -2,338 +2,1390 @@
 
 #define TAG "SeaderCCID"
 
-bool hasSAM = false;
-const uint8_t SAM_ATR[] =
-    {0x3b, 0x95, 0x96, 0x80, 0xb1, 0xfe, 0x55, 0x1f, 0xc7, 0x47, 0x72, 0x61, 0x63, 0x65, 0x13};
-const uint8_t SAM_ATR2[] = {0x3b, 0x90, 0x96, 0x91, 0x81, 0xb1, 0xfe, 0x55, 0x1f, 0xc7, 0xd4};
 
-bool powered[2] = {false, false};
-uint8_t sam_slot = 0;
-uint8_t sequence[2] = {0, 0};
-uint8_t retries = 3;
+uint8_t getSequence(SeaderCcidContext* ccid, uint8_t slot) {
+    if(ccid->sequence[slot] > 254) {
+        ccid->sequence[slot] = 0;
+    }
+    return ccid->sequence[slot]++;
+}
+
+static void seader_ccid_timer_callback(void* context) {
+    SeaderCcidContext* ccid = context;
+    furi_thread_flags_set(furi_thread_get_id(ccid->uart->thread), WorkerEvtCcidTimeout);
+}
+
+static void seader_ccid_idle_callback(void* context) {
+    SeaderCcidContext* ccid = context;
+    furi_thread_flags_set(furi_thread_get_id(ccid->uart->thread), WorkerEvtSamIdle);
+}
 
-uint8_t getSequence(uint8_t slot) {
-    if(sequence[slot] > 254) {
-        sequence[slot] = 0;
+void seader_ccid_context_init(SeaderCcidContext* ccid, SeaderUartBridge* seader_uart) {
+    memset(ccid, 0, sizeof(SeaderCcidContext));
+    ccid->uart = seader_uart;
+    ccid->lock = furi_mutex_alloc(FuriMutexTypeRecursive);
+    ccid->selected = furi_semaphore_alloc(1, 0);
+    ccid->timer = furi_timer_alloc(seader_ccid_timer_callback, FuriTimerTypeOnce, ccid);
+    ccid->idle_timer = furi_timer_alloc(seader_ccid_idle_callback, FuriTimerTypeOnce, ccid);
+}
+
+void seader_ccid_context_free(SeaderCcidContext* ccid) {
+    furi_timer_stop(ccid->timer);
+    furi_timer_free(ccid->timer);
+    ccid->timer = NULL;
+    furi_timer_stop(ccid->idle_timer);
+    furi_timer_free(ccid->idle_timer);
+    ccid->idle_timer = NULL;
+    furi_mutex_free(ccid->lock);
+    ccid->lock = NULL;
+    furi_semaphore_free(ccid->selected);
+    ccid->selected = NULL;
+}
+
+/* Pushes the power off back by the configured idle time */
+static void seader_ccid_idle_restart(SeaderCcidContext* ccid) {
+    uint32_t idle_ms = ccid->uart->cfg.sam_idle_off_ms;
+    if(idle_ms > 0) {
+        furi_timer_start(ccid->idle_timer, furi_ms_to_ticks(idle_ms));
     }
-    return sequence[slot]++;
+}
+
+/* XOR of len bytes, folded from 32 bit words so a full frame costs a quarter of the loads */
+uint8_t seader_ccid_lrc(const uint8_t* data, size_t len) {
+    uint32_t acc = 0;
+    for(; len >= sizeof(uint32_t); len -= sizeof(uint32_t), data += sizeof(uint32_t)) {
+        uint32_t word;
+        // Compiles to a single unaligned load on the M4
+        memcpy(&word, data, sizeof(word));
+        acc ^= word;
+    }
+    acc ^= acc >> 16;
+    acc ^= acc >> 8;
+
+    uint8_t lrc = acc & 0xff;
+    while(len--) {
+        lrc ^= *data++;
+    }
+    return lrc;
 }
 
 size_t seader_ccid_add_lrc(uint8_t* data, size_t len) {
-    uint8_t lrc = 0;
+    data[len] = seader_ccid_lrc(data, len);
+    return len + 1;
+}
+
+static uint32_t seader_ccid_timeout_ms(uint8_t message_type) {
+    switch(message_type) {
+    case CCID_MESSAGE_TYPE_PC_to_RDR_XfrBlock:
+        return SEADER_CCID_XFR_TIMEOUT_MS;
+    case CCID_MESSAGE_TYPE_PC_to_RDR_IccPowerOn:
+        return SEADER_CCID_POWER_ON_TIMEOUT_MS;
+    default:
+        return SEADER_CCID_CMD_TIMEOUT_MS;
+    }
+}
+
+/* Points the timer at the earliest deadline still pending, stops it when nothing is */
+static void seader_ccid_arm_timer(SeaderCcidContext* ccid) {
+    furi_mutex_acquire(ccid->lock, FuriWaitForever);
+    uint32_t now = furi_get_tick();
+    uint32_t next = UINT32_MAX;
+    for(size_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+        SeaderCcidRequest* request = &ccid->pending[slot];
+        if(request->active) {
+            int32_t left = (int32_t)(request->deadline - now);
+            next = MIN(next, (uint32_t)MAX(left, 1));
+        }
+    }
+    if(next != UINT32_MAX) {
+        furi_timer_start(ccid->timer, next);
+    } else if(furi_timer_is_running(ccid->timer)) {
+        furi_timer_stop(ccid->timer);
+    }
+    furi_mutex_release(ccid->lock);
+}
+
+/* Takes a command off pending and lets the transport reuse its frame, ccid->lock is held */
+static void seader_ccid_retire(SeaderCcidContext* ccid, SeaderCcidRequest* request) {
+    if(request->active) {
+        request->active = false;
+        ccid->uart->transport->release(ccid->uart, request->frame);
+        request->frame = NULL;
+    }
+}
+
+static void seader_ccid_pending_clear(SeaderCcidContext* ccid, uint8_t slot) {
+    furi_mutex_acquire(ccid->lock, FuriWaitForever);
+    seader_ccid_retire(ccid, &ccid->pending[slot]);
+    furi_mutex_release(ccid->lock);
+    if(slot == ccid->sam_slot) {
+        ccid->apdu_pending = false;
+    }
+    if(ccid->sams[slot].power != SeaderSamPowerOn) {
+        // The wake was lost, the next APDU starts another one
+        ccid->sams[slot].power = SeaderSamPowerOff;
+    }
+}
+
+/* Adds the LRC, records the command as waiting for its answer and sends it */
+static void seader_ccid_send(SeaderCcidContext* ccid, uint8_t* tx_buf, size_t len) {
+    len = seader_ccid_add_lrc(tx_buf, len);
+
+    uint8_t slot = tx_buf[2 + 5];
+    SeaderCcidRequest* request = &ccid->pending[slot];
+    // Recorded before it goes out, the answer may be parsed before send returns
+    furi_mutex_acquire(ccid->lock, FuriWaitForever);
+    // Whatever this replaces, e.g. the command an Abort is for, will not be sent again
+    seader_ccid_retire(ccid, request);
+    request->frame = tx_buf;
+    request->type = tx_buf[2];
+    request->seq = tx_buf[2 + 6];
+    request->retries = 0;
+    request->deadline = furi_get_tick() + furi_ms_to_ticks(seader_ccid_timeout_ms(tx_buf[2]));
+    request->active = true;
+    ccid->last_slot = slot;
+    seader_ccid_arm_timer(ccid);
+    // Under the lock so the frame cannot be retired before the transport has it
+    ccid->uart->transport->send(ccid->uart, tx_buf, len);
+    furi_mutex_release(ccid->lock);
+}
+
+static void seader_ccid_probe_done(Seader* seader, SeaderCcidContext* ccid, uint8_t slot);
+
+/* A command will never be answered, whoever was waiting for it gets a verdict instead */
+static void seader_ccid_request_lost(SeaderCcidContext* ccid, uint8_t slot, uint8_t type) {
+    Seader* seader = ccid->uart->seader;
+    SeaderWorker* seader_worker = seader->worker;
+
+    if(ccid->probing & (1 << slot)) {
+        // Nothing answers on this slot, that is the probe's verdict rather than the popup's
+        seader_ccid_probe_done(seader, ccid, slot);
+        return;
+    }
+    if(type != CCID_MESSAGE_TYPE_PC_to_RDR_XfrBlock || slot != ccid->sam_slot) {
+        return;
+    }
+    if(ccid->uart == seader->uart) {
+        seader_worker_version_failed(seader);
+    }
+    if(seader_worker->uart == ccid->uart &&
+       seader_worker->stage == SeaderPollerEventTypeConversation) {
+        seader_worker_abort(seader);
+    }
+}
+
+/* Sends a pending command again, false once it has used up its retransmits and was dropped */
+static bool seader_ccid_retransmit(SeaderCcidContext* ccid, uint8_t slot) {
+    if(slot >= SEADER_CCID_SLOTS) {
+        return false;
+    }
+    SeaderCcidRequest* request = &ccid->pending[slot];
+    furi_mutex_acquire(ccid->lock, FuriWaitForever);
+    if(!request->active) {
+        furi_mutex_release(ccid->lock);
+        return false;
+    }
+    uint8_t type = request->type;
+    if(request->retries >= SEADER_CCID_RETRANSMIT_MAX) {
+        FURI_LOG_W(
+            TAG,
+            "Slot %d seq %d unanswered after %d retries",
+            slot,
+            request->seq,
+            request->retries);
+        ccid->uart->st.requests_lost++;
+        if(ccid->sams[slot].present) {
+            ccid->sams[slot].errors++;
+        }
+        seader_ccid_pending_clear(ccid, slot);
+        seader_ccid_arm_timer(ccid);
+        furi_mutex_release(ccid->lock);
+        seader_ccid_request_lost(ccid, slot, type);
+        return false;
+    }
+    request->retries++;
+    request->deadline = furi_get_tick() + furi_ms_to_ticks(seader_ccid_timeout_ms(type));
+    seader_ccid_arm_timer(ccid);
+    // The frame was held since it was first sent, it goes out again without a copy
+    ccid->uart->transport->resend(ccid->uart, request->frame);
+    furi_mutex_release(ccid->lock);
+    return true;
+}
+
+static uint8_t seader_ccid_last_slot(SeaderCcidContext* ccid) {
+    furi_mutex_acquire(ccid->lock, FuriWaitForever);
+    uint8_t slot = ccid->last_slot;
+    furi_mutex_release(ccid->lock);
+    return slot;
+}
+
+/* The answer to the last command was lost to a line error */
+void seader_ccid_resend(SeaderCcidContext* ccid) {
+    if(seader_ccid_retransmit(ccid, seader_ccid_last_slot(ccid))) {
+        ccid->uart->st.resends++;
+    }
+}
+
+/* Called on WorkerEvtCcidTimeout, retransmits whatever is past its deadline */
+void seader_ccid_timeout(SeaderCcidContext* ccid) {
+    if(ccid->uart->baudrate_state != SeaderUartBaudrateStateIdle) {
+        // The negotiation has its own timeout and falls back to the default rate on it
+        return;
+    }
+    uint32_t now = furi_get_tick();
+    for(uint8_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+        SeaderCcidRequest* request = &ccid->pending[slot];
+        furi_mutex_acquire(ccid->lock, FuriWaitForever);
+        bool expired = request->active && (int32_t)(now - request->deadline) >= 0;
+        uint8_t seq = request->seq;
+        furi_mutex_release(ccid->lock);
+        if(!expired) {
+            continue;
+        }
+        FURI_LOG_W(TAG, "Slot %d seq %d timed out", slot, seq);
+        if(seader_ccid_retransmit(ccid, slot)) {
+            ccid->uart->st.timeout_resends++;
+        }
+    }
+    seader_ccid_arm_timer(ccid);
+}
+
+/* Keeps the command an answer belongs to pending, multiplier times its usual deadline from now */
+static bool seader_ccid_defer(SeaderCcidContext* ccid, CCID_Message* message, uint8_t multiplier) {
+    SeaderCcidRequest* request =
+        message->bSlot < SEADER_CCID_SLOTS ? &ccid->pending[message->bSlot] : NULL;
+    furi_mutex_acquire(ccid->lock, FuriWaitForever);
+    if(!request || !request->active || request->seq != message->bSeq) {
+        furi_mutex_release(ccid->lock);
+        ccid->uart->st.stale_answers++;
+        return false;
+    }
+    uint32_t wait_ms = seader_ccid_timeout_ms(request->type) * MAX(multiplier, 1);
+    request->deadline = furi_get_tick() + furi_ms_to_ticks(wait_ms);
+    seader_ccid_arm_timer(ccid);
+    furi_mutex_release(ccid->lock);
+    return true;
+}
+
+/*
+ * Retires the command an answer belongs to, false for answers nothing is waiting on. sent_tick
+ * is when that command's frame last finished going out.
+ */
+static bool
+    seader_ccid_match(SeaderCcidContext* ccid, CCID_Message* message, uint32_t* sent_tick) {
+    SeaderCcidRequest* request =
+        message->bSlot < SEADER_CCID_SLOTS ? &ccid->pending[message->bSlot] : NULL;
+    furi_mutex_acquire(ccid->lock, FuriWaitForever);
+    if(!request || !request->active || request->seq != message->bSeq) {
+        furi_mutex_release(ccid->lock);
+        FURI_LOG_W(TAG, "Stale answer, slot %d seq %d", message->bSlot, message->bSeq);
+        ccid->uart->st.stale_answers++;
+        return false;
+    }
+    *sent_tick = ccid->uart->transport->sent_tick(ccid->uart, request->frame);
+    seader_ccid_retire(ccid, request);
+    seader_ccid_arm_timer(ccid);
+    furi_mutex_release(ccid->lock);
+    return true;
+}
+
+/* ISO 7816-3 tables 7 and 8, fmax is in 100kHz units */
+const uint16_t seader_ccid_fi[16] =
+    {372, 372, 558, 744, 1116, 1488, 1860, 0, 0, 512, 768, 1024, 1536, 2048, 0, 0};
+const uint8_t seader_ccid_fmax[16] =
+    {40, 50, 60, 80, 120, 160, 200, 0, 0, 50, 75, 100, 150, 200, 0, 0};
+const uint8_t seader_ccid_di[16] = {0, 1, 2, 4, 8, 16, 32, 64, 12, 20, 0, 0, 0, 0, 0, 0};
+const uint32_t seader_uart_baudrates[] = {115200, 230400, 460800, 921600};
+
+/* Slowest UART rate that keeps up with the SAM's advertised Fi/Di */
+uint32_t seader_ccid_baudrate_for_ta1(uint8_t ta1) {
+    uint8_t fi = ta1 >> 4;
+    uint8_t di = ta1 & 0x0f;
+    if(seader_ccid_fi[fi] == 0 || seader_ccid_di[di] == 0) {
+        return SEADER_UART_BAUDRATE_DEFAULT;
+    }
+
+    uint32_t icc_rate =
+        (uint32_t)seader_ccid_fmax[fi] * 100000 / seader_ccid_fi[fi] * seader_ccid_di[di];
+    size_t count = sizeof(seader_uart_baudrates) / sizeof(seader_uart_baudrates[0]);
+    for(size_t i = 0; i < count; i++) {
+        if(seader_uart_baudrates[i] >= icc_rate) {
+            return seader_uart_baudrates[i];
+        }
+    }
+    return seader_uart_baudrates[count - 1];
+}
+
+/* ISO 7816-3 8.2, false when the bytes do not add up to an ATR */
+bool seader_ccid_atr_parse(const uint8_t* atr, size_t len, SeaderAtr* out) {
+    memset(out, 0, sizeof(SeaderAtr));
+    out->ta1 = 0x11;
+    out->ifsc = 0x20;
+    out->bwi_cwi = 0x4d;
+    out->hash = 2166136261u;
     for(size_t i = 0; i < len; i++) {
-        lrc ^= data[i];
+        out->hash = (out->hash ^ atr[i]) * 16777619u;
     }
-    data[len] = lrc;
-    return len + 1;
+
+    if(len < 2 || len > SEADER_ATR_MAX_LEN || (atr[0] != 0x3b && atr[0] != 0x3f)) {
+        return false;
+    }
+    out->ts = atr[0];
+    out->t0 = atr[1];
+
+    size_t pos = 2;
+    uint8_t y = out->t0 >> 4;
+    // Protocol announced by the TD in front of the current group
+    uint8_t t = 0;
+    bool t1_ta = false;
+    bool t1_tb = false;
+    bool tck = false;
+    for(uint8_t i = 1; y != 0; i++) {
+        uint8_t bytes[4] = {0};
+        for(uint8_t b = 0; b < 4; b++) {
+            if(y & (1 << b)) {
+                if(pos >= len) {
+                    return false;
+                }
+                bytes[b] = atr[pos++];
+            }
+        }
+        // bytes[] is TA, TB, TC, TD of group i
+        if(i == 1) {
+            if(y & 0x1) {
+                out->ta1 = bytes[0];
+            }
+            if(y & 0x4) {
+                out->tc1 = bytes[2];
+            }
+        } else if(i == 2) {
+            if(y & 0x1) {
+                out->specific_mode = true;
+                out->ta2 = bytes[0];
+            }
+        } else if(t == 1) {
+            if((y & 0x1) && !t1_ta) {
+                out->ifsc = bytes[0];
+                t1_ta = true;
+            }
+            if((y & 0x2) && !t1_tb) {
+                out->bwi_cwi = bytes[1];
+                t1_tb = true;
+            }
+        }
+        if(!(y & 0x8)) {
+            break;
+        }
+        t = bytes[3] & 0x0f;
+        out->protocols |= 1 << t;
+        tck |= t != 0;
+        y = bytes[3] >> 4;
+    }
+    if(out->protocols == 0) {
+        out->protocols = 1 << 0;
+    }
+
+    out->historical_len = out->t0 & 0x0f;
+    if(pos + out->historical_len > len) {
+        return false;
+    }
+    memcpy(out->historical, atr + pos, out->historical_len);
+    pos += out->historical_len;
+
+    if(tck) {
+        if(pos >= len) {
+            return false;
+        }
+        // XOR from T0 through TCK is 0
+        out->tck_ok = seader_ccid_lrc(atr + 1, pos) == 0;
+        pos++;
+    } else {
+        out->tck_ok = true;
+    }
+    return out->tck_ok;
 }
 
-void seader_ccid_IccPowerOn(SeaderUartBridge* seader_uart, uint8_t slot) {
-    if(powered[slot]) {
+/* The version query settles it, any intact ATR that offers T=1 is worth asking */
+static bool seader_ccid_atr_is_sam(const SeaderAtr* atr) {
+    return atr->protocols & (1 << 1);
+}
+
+void seader_ccid_IccPowerOn(SeaderCcidContext* ccid, uint8_t slot) {
+    if(ccid->powered[slot]) {
         return;
     }
-    powered[slot] = true;
+    ccid->powered[slot] = true;
 
     FURI_LOG_D(TAG, "Sending Power On (%d)", slot);
-    memset(seader_uart->tx_buf, 0, SEADER_UART_RX_BUF_SIZE);
-    seader_uart->tx_buf[0] = SYNC;
-    seader_uart->tx_buf[1] = CTRL;
-    seader_uart->tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_IccPowerOn;
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_IccPowerOn;
 
-    seader_uart->tx_buf[2 + 5] = slot;
-    seader_uart->tx_buf[2 + 6] = getSequence(slot);
-    seader_uart->tx_buf[2 + 7] = 2; //power
+    tx_buf[2 + 5] = slot;
+    tx_buf[2 + 6] = getSequence(ccid, slot);
+    tx_buf[2 + 7] = 2; //power
 
-    seader_uart->tx_len = seader_ccid_add_lrc(seader_uart->tx_buf, 2 + 10);
-    furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtSamRx);
+    seader_ccid_send(ccid, tx_buf, 2 + 10);
 }
 
-void seader_ccid_check_for_sam(SeaderUartBridge* seader_uart) {
-    hasSAM = false; // If someone is calling this, reset sam state
-    powered[0] = false;
-    powered[1] = false;
-    retries = 3;
-    seader_ccid_GetSlotStatus(seader_uart, 0);
+void seader_ccid_IccPowerOff(SeaderCcidContext* ccid, uint8_t slot) {
+    ccid->powered[slot] = false;
+
+    FURI_LOG_D(TAG, "Sending Power Off (%d)", slot);
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_IccPowerOff;
+    tx_buf[2 + 5] = slot;
+    tx_buf[2 + 6] = getSequence(ccid, slot);
+
+    seader_ccid_send(ccid, tx_buf, 2 + 10);
+}
+
+/* Called on WorkerEvtSamIdle, powers the SAMs off unless an APDU got in first */
+void seader_ccid_idle(SeaderCcidContext* ccid) {
+    uint8_t power_off = 0;
+    FURI_CRITICAL_ENTER();
+    // A busy SAM restarts the timer with its next answer
+    if(!ccid->apdu_pending && ccid->uart->baudrate_state == SeaderUartBaudrateStateIdle) {
+        for(uint8_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+            SeaderSam* sam = &ccid->sams[slot];
+            if(sam->present && sam->power == SeaderSamPowerOn) {
+                sam->power = SeaderSamPowerOff;
+                power_off |= 1 << slot;
+            }
+        }
+    }
+    FURI_CRITICAL_EXIT();
+
+    for(uint8_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+        if(power_off & (1 << slot)) {
+            FURI_LOG_I(TAG, "SAM idle, powering off slot %d", slot);
+            ccid->uart->st.sam_power_offs++;
+            seader_ccid_IccPowerOff(ccid, slot);
+        }
+    }
+}
+
+void seader_ccid_check_for_sam(SeaderCcidContext* ccid) {
+    ccid->has_sam = false; // If someone is calling this, reset sam state
+    for(uint8_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+        // Busy time and errors are kept, the same SAMs are most likely found again
+        ccid->sams[slot].present = false;
+        ccid->sams[slot].power = SeaderSamPowerOn;
+    }
+    ccid->powered[0] = false;
+    ccid->powered[1] = false;
+    ccid->probe_wrong = false;
+    // Each slot can have its own command outstanding, so both are asked at once
+    ccid->probing = (1 << SEADER_CCID_SLOTS) - 1;
+    for(uint8_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+        seader_ccid_GetSlotStatus(ccid, slot);
+    }
 }
 
-void seader_ccid_GetSlotStatus(SeaderUartBridge* seader_uart, uint8_t slot) {
+void seader_ccid_GetSlotStatus(SeaderCcidContext* ccid, uint8_t slot) {
     FURI_LOG_D(TAG, "seader_ccid_GetSlotStatus(%d)", slot);
-    memset(seader_uart->tx_buf, 0, SEADER_UART_RX_BUF_SIZE);
-    seader_uart->tx_buf[0] = SYNC;
-    seader_uart->tx_buf[1] = CTRL;
-    seader_uart->tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_GetSlotStatus;
-    seader_uart->tx_buf[2 + 5] = slot;
-    seader_uart->tx_buf[2 + 6] = getSequence(slot);
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_GetSlotStatus;
+    tx_buf[2 + 5] = slot;
+    tx_buf[2 + 6] = getSequence(ccid, slot);
 
-    seader_uart->tx_len = seader_ccid_add_lrc(seader_uart->tx_buf, 2 + 10);
-    furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtSamRx);
+    seader_ccid_send(ccid, tx_buf, 2 + 10);
 }
 
-void seader_ccid_SetParameters(SeaderUartBridge* seader_uart) {
+void seader_ccid_SetParameters(SeaderCcidContext* ccid) {
+    const SeaderAtr* atr = &ccid->atr[ccid->sam_slot];
     uint8_t T1 = 1;
-    memset(seader_uart->tx_buf, 0, SEADER_UART_RX_BUF_SIZE);
-    seader_uart->tx_buf[0] = SYNC;
-    seader_uart->tx_buf[1] = CTRL;
-    seader_uart->tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_SetParameters;
-    seader_uart->tx_buf[2 + 1] = 0;
-    seader_uart->tx_buf[2 + 5] = sam_slot;
-    seader_uart->tx_buf[2 + 6] = getSequence(sam_slot);
-    seader_uart->tx_buf[2 + 7] = T1;
-    seader_uart->tx_buf[2 + 8] = 0;
-    seader_uart->tx_buf[2 + 9] = 0;
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_SetParameters;
+    tx_buf[2 + 1] = 7;
+    tx_buf[2 + 5] = ccid->sam_slot;
+    tx_buf[2 + 6] = getSequence(ccid, ccid->sam_slot);
+    tx_buf[2 + 7] = T1;
+    tx_buf[2 + 8] = 0;
+    tx_buf[2 + 9] = 0;
+
+    // abProtocolDataStructure for T=1 (CCID Rev 1.1 6.1.7)
+    tx_buf[2 + 10 + 0] = atr->ta1; // bmFindexDindex
+    tx_buf[2 + 10 + 1] = 0x10; // bmTCCKST1: LRC
+    tx_buf[2 + 10 + 2] = atr->tc1; // bGuardTimeT1
+    tx_buf[2 + 10 + 3] = atr->bwi_cwi; // bmWaitingIntegersT1
+    tx_buf[2 + 10 + 4] = 0; // bClockStop
+    tx_buf[2 + 10 + 5] = atr->ifsc; // bIFSC
+    tx_buf[2 + 10 + 6] = 0; // bNadValue
+
+    seader_ccid_send(ccid, tx_buf, 2 + 10 + 7);
+}
+
+void seader_ccid_SetDataRateAndClockFrequency(SeaderCcidContext* ccid, uint32_t baudrate) {
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_SetDataRateAndClockFrequency;
+    tx_buf[2 + 1] = 8;
+    tx_buf[2 + 5] = ccid->sam_slot;
+    tx_buf[2 + 6] = getSequence(ccid, ccid->sam_slot);
 
-    seader_uart->tx_len = seader_ccid_add_lrc(seader_uart->tx_buf, 2 + 10);
+    // dwClockFrequency left at 0 so the reader keeps its clock, then dwDataRate
+    memset(tx_buf + 2 + 10, 0, 4);
+    tx_buf[2 + 10 + 4] = baudrate & 0xff;
+    tx_buf[2 + 10 + 5] = (baudrate >> 8) & 0xff;
+    tx_buf[2 + 10 + 6] = (baudrate >> 16) & 0xff;
+    tx_buf[2 + 10 + 7] = (baudrate >> 24) & 0xff;
 
-    furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtSamRx);
+    seader_ccid_send(ccid, tx_buf, 2 + 10 + 8);
 }
 
-void seader_ccid_GetParameters(SeaderUartBridge* seader_uart) {
-    memset(seader_uart->tx_buf, 0, SEADER_UART_RX_BUF_SIZE);
-    seader_uart->tx_buf[0] = SYNC;
-    seader_uart->tx_buf[1] = CTRL;
-    seader_uart->tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_GetParameters;
-    seader_uart->tx_buf[2 + 1] = 0;
-    seader_uart->tx_buf[2 + 5] = sam_slot;
-    seader_uart->tx_buf[2 + 6] = getSequence(sam_slot);
-    seader_uart->tx_buf[2 + 7] = 0;
-    seader_uart->tx_buf[2 + 8] = 0;
-    seader_uart->tx_buf[2 + 9] = 0;
+void seader_ccid_GetParameters(SeaderCcidContext* ccid) {
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_GetParameters;
+    tx_buf[2 + 1] = 0;
+    tx_buf[2 + 5] = ccid->sam_slot;
+    tx_buf[2 + 6] = getSequence(ccid, ccid->sam_slot);
+    tx_buf[2 + 7] = 0;
+    tx_buf[2 + 8] = 0;
+    tx_buf[2 + 9] = 0;
 
-    seader_uart->tx_len = seader_ccid_add_lrc(seader_uart->tx_buf, 2 + 10);
+    seader_ccid_send(ccid, tx_buf, 2 + 10);
+}
 
-    furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtSamRx);
+void seader_ccid_XfrBlock(SeaderCcidContext* ccid, uint8_t* data, size_t len) {
+    seader_ccid_XfrBlockToSlot(ccid, ccid->sam_slot, data, len);
 }
 
-void seader_ccid_XfrBlock(SeaderUartBridge* seader_uart, uint8_t* data, size_t len) {
-    seader_ccid_XfrBlockToSlot(seader_uart, sam_slot, data, len);
+/* Fills in the header of an XfrBlock carrying len bytes */
+static void seader_ccid_XfrBlockHeader(
+    SeaderCcidContext* ccid,
+    uint8_t* tx_buf,
+    uint8_t slot,
+    size_t len,
+    uint16_t level) {
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_XfrBlock;
+    tx_buf[2 + 1] = (len >> 0) & 0xff;
+    tx_buf[2 + 2] = (len >> 8) & 0xff;
+    tx_buf[2 + 3] = (len >> 16) & 0xff;
+    tx_buf[2 + 4] = (len >> 24) & 0xff;
+    tx_buf[2 + 5] = slot;
+    tx_buf[2 + 6] = getSequence(ccid, slot);
+    tx_buf[2 + 7] = 5;
+    tx_buf[2 + 8] = level & 0xff;
+    tx_buf[2 + 9] = (level >> 8) & 0xff;
+}
+
+static void seader_ccid_XfrBlockLevel(
+    SeaderCcidContext* ccid,
+    uint8_t slot,
+    uint8_t* data,
+    size_t len,
+    uint16_t level) {
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    if(len > 0) {
+        memcpy(tx_buf + SEADER_CCID_HEADER_LEN, data, len);
+    }
+    seader_ccid_XfrBlockHeader(ccid, tx_buf, slot, len, level);
+    seader_ccid_send(ccid, tx_buf, SEADER_CCID_HEADER_LEN + len);
+}
+
+/* Largest block the SAM takes, IFSC from its ATR */
+static size_t seader_ccid_block_size(SeaderCcidContext* ccid, uint8_t slot) {
+    size_t ifsc = ccid->atr[slot].ifsc;
+    return ifsc ? MIN(ifsc, (size_t)SEADER_APDU_MAX_LEN) : SEADER_APDU_MAX_LEN;
+}
+
+static void seader_ccid_chain_next(SeaderCcidContext* ccid) {
+    size_t left = ccid->tx_chain_len - ccid->tx_chain_pos;
+    size_t len = MIN(left, seader_ccid_block_size(ccid, ccid->chain_slot));
+    uint16_t level;
+    if(ccid->tx_chain_pos == 0) {
+        level = len == left ? CCID_CHAIN_NONE : CCID_CHAIN_BEGIN;
+    } else {
+        level = len == left ? CCID_CHAIN_END : CCID_CHAIN_CONTINUE;
+    }
+    seader_ccid_XfrBlockLevel(
+        ccid, ccid->chain_slot, ccid->tx_chain + ccid->tx_chain_pos, len, level);
+    ccid->tx_chain_pos += len;
+}
+
+/* Sends the len byte APDU already in tx_buf behind the header room */
+static void seader_ccid_XfrBlockFrame(
+    SeaderCcidContext* ccid,
+    uint8_t slot,
+    uint8_t* tx_buf,
+    size_t len) {
+    uint8_t* apdu = tx_buf + SEADER_CCID_HEADER_LEN;
+    ccid->aborting = false;
+    ccid->rx_chain_len = 0;
+    ccid->tx_chain_len = 0;
+    ccid->tx_chain_pos = 0;
+    ccid->chain_slot = slot;
+
+    SeaderSam* sam = &ccid->sams[slot];
+    sam->busy_since = furi_get_tick();
+    bool deferred = false;
+    bool wake = false;
+    FURI_CRITICAL_ENTER();
+    ccid->apdu_pending = true;
+    if(sam->present && sam->power != SeaderSamPowerOn) {
+        deferred = true;
+        wake = sam->power == SeaderSamPowerOff;
+        if(wake) {
+            sam->power = SeaderSamPowerWaking;
+        }
+    }
+    FURI_CRITICAL_EXIT();
+
+    if(deferred) {
+        // Kept in tx_chain until the SAM is back, the frame goes back unsent so the power on
+        // can have one
+        memcpy(ccid->tx_chain, apdu, len);
+        ccid->tx_chain_len = len;
+        ccid->uart->transport->send(ccid->uart, tx_buf, 0);
+        if(wake) {
+            FURI_LOG_D(TAG, "Waking SAM for an APDU");
+            ccid->wake_tick = furi_get_tick();
+            seader_ccid_IccPowerOn(ccid, slot);
+        }
+        return;
+    }
+
+    uint16_t level = CCID_CHAIN_NONE;
+    size_t block = seader_ccid_block_size(ccid, slot);
+    if(len > block) {
+        // Longer than the SAM takes in one block, the rest follows as the reader asks for it
+        memcpy(ccid->tx_chain + block, apdu + block, len - block);
+        ccid->tx_chain_len = len;
+        ccid->tx_chain_pos = block;
+        level = CCID_CHAIN_BEGIN;
+        len = block;
+    }
+    seader_ccid_XfrBlockHeader(ccid, tx_buf, slot, len, level);
+    seader_ccid_send(ccid, tx_buf, SEADER_CCID_HEADER_LEN + len);
+}
+
+uint8_t* seader_ccid_XfrBlockAcquire(SeaderCcidContext* ccid) {
+    return ccid->uart->transport->acquire(ccid->uart);
+}
+
+void seader_ccid_XfrBlockSend(SeaderCcidContext* ccid, uint8_t* tx_buf, size_t len) {
+    if(len == 0) {
+        ccid->uart->transport->send(ccid->uart, tx_buf, 0);
+        return;
+    }
+    seader_ccid_XfrBlockFrame(ccid, ccid->sam_slot, tx_buf, len);
 }
 
 void seader_ccid_XfrBlockToSlot(
-    SeaderUartBridge* seader_uart,
+    SeaderCcidContext* ccid,
     uint8_t slot,
     uint8_t* data,
     size_t len) {
-    memset(seader_uart->tx_buf, 0, SEADER_UART_RX_BUF_SIZE);
-    seader_uart->tx_buf[0] = SYNC;
-    seader_uart->tx_buf[1] = CTRL;
-    seader_uart->tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_XfrBlock;
-    seader_uart->tx_buf[2 + 1] = len;
-    seader_uart->tx_buf[2 + 5] = slot;
-    seader_uart->tx_buf[2 + 6] = getSequence(slot);
-    seader_uart->tx_buf[2 + 7] = 5;
-    seader_uart->tx_buf[2 + 8] = 0;
-    seader_uart->tx_buf[2 + 9] = 0;
+    if(len > SEADER_APDU_MAX_LEN) {
+        FURI_LOG_E(TAG, "XfrBlock too long: %d", len);
+        return;
+    }
 
-    memcpy(seader_uart->tx_buf + 2 + 10, data, len);
-    seader_uart->tx_len = seader_ccid_add_lrc(seader_uart->tx_buf, 2 + 10 + len);
-    // FURI_LOG_I(TAG, "seader_ccid_XfrBlock %d bytes", seader_uart->tx_len);
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    memcpy(tx_buf + SEADER_CCID_HEADER_LEN, data, len);
+    seader_ccid_XfrBlockFrame(ccid, slot, tx_buf, len);
+}
+
+/* Cancels the exchange on the SAM slot, the SlotStatus it answers with says the SAM is idle */
+void seader_ccid_Abort(SeaderCcidContext* ccid) {
+    uint8_t slot = ccid->sam_slot;
+    FURI_LOG_D(TAG, "Sending Abort (%d)", slot);
+    ccid->tx_chain_len = 0;
+    ccid->tx_chain_pos = 0;
+    ccid->rx_chain_len = 0;
+    if(ccid->sams[slot].power != SeaderSamPowerOn) {
+        // Nothing reached the SAM yet, the wake finishes with an empty tx_chain
+        ccid->apdu_pending = false;
+        return;
+    }
+    ccid->aborting = true;
+
+    uint8_t* tx_buf = ccid->uart->transport->acquire(ccid->uart);
+    tx_buf[0] = SYNC;
+    tx_buf[1] = CTRL;
+    tx_buf[2 + 0] = CCID_MESSAGE_TYPE_PC_to_RDR_Abort;
+    tx_buf[2 + 5] = slot;
+    tx_buf[2 + 6] = getSequence(ccid, slot);
 
-    furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtSamRx);
+    // Takes the aborted command's place in pending, so a late answer to it is dropped as stale
+    seader_ccid_send(ccid, tx_buf, 2 + 10);
 }
 
-size_t seader_ccid_process(Seader* seader, uint8_t* cmd, size_t cmd_len) {
-    SeaderWorker* seader_worker = seader->worker;
-    SeaderUartBridge* seader_uart = seader_worker->uart;
-    CCID_Message message;
-    message.consumed = 0;
-
-    char display[SEADER_UART_RX_BUF_SIZE * 2 + 1] = {0};
-    for(uint8_t i = 0; i < cmd_len; i++) {
-        snprintf(display + (i * 2), sizeof(display), "%02x", cmd[i]);
-    }
-    // FURI_LOG_D(TAG, "UART %d: %s", cmd_len, display);
-
-    if(cmd_len == 2) {
-        if(cmd[0] == CCID_MESSAGE_TYPE_RDR_to_PC_NotifySlotChange) {
-            switch(cmd[1] & SLOT_0_MASK) {
-            case 0:
-            case 1:
-                // No change, no-op
-                break;
-            case CARD_IN_1:
-                FURI_LOG_D(TAG, "Card Inserted (0)");
-                if(hasSAM && sam_slot == 0) {
-                    break;
-                }
-                sequence[0] = 0;
-                seader_ccid_IccPowerOn(seader_uart, 0);
-                break;
-            case CARD_OUT_1:
-                FURI_LOG_D(TAG, "Card Removed (0)");
-                if(hasSAM && sam_slot == 0) {
-                    powered[0] = false;
-                    hasSAM = false;
-                    retries = 3;
-                }
-                break;
-            };
+/* Moves a chained XfrBlock along in either direction, true once message holds the response */
+static bool seader_ccid_chain(SeaderCcidContext* ccid, CCID_Message* message) {
+    if(message->bChainParameter == CCID_CHAIN_EMPTY) {
+        if(ccid->tx_chain_pos < ccid->tx_chain_len) {
+            seader_ccid_chain_next(ccid);
+        } else {
+            FURI_LOG_W(TAG, "Reader asked for a block that is not there");
+        }
+        return false;
+    }
+    if(message->bChainParameter == CCID_CHAIN_NONE && ccid->rx_chain_len == 0) {
+        return true;
+    }
 
-            switch(cmd[1] & SLOT_1_MASK) {
-            case 0:
-            case 1:
-                // No change, no-op
-                break;
-            case CARD_IN_2:
-                FURI_LOG_D(TAG, "Card Inserted (1)");
-                if(hasSAM && sam_slot == 1) {
-                    break;
-                }
-                sequence[1] = 0;
-                seader_ccid_IccPowerOn(seader_uart, 1);
-                break;
-            case CARD_OUT_2:
-                FURI_LOG_D(TAG, "Card Removed (1)");
-                if(hasSAM && sam_slot == 1) {
-                    powered[1] = false;
-                    hasSAM = false;
-                    retries = 3;
-                }
-                break;
-            };
+    if(message->bChainParameter == CCID_CHAIN_BEGIN) {
+        ccid->rx_chain_len = 0;
+    }
+    if(ccid->rx_chain_len + message->dwLength > sizeof(ccid->rx_chain)) {
+        FURI_LOG_E(TAG, "Chained response over %d bytes", sizeof(ccid->rx_chain));
+        ccid->rx_chain_len = 0;
+        ccid->apdu_pending = false;
+        return false;
+    }
+    memcpy(ccid->rx_chain + ccid->rx_chain_len, message->payload, message->dwLength);
+    ccid->rx_chain_len += message->dwLength;
+
+    if(message->bChainParameter == CCID_CHAIN_BEGIN ||
+       message->bChainParameter == CCID_CHAIN_CONTINUE) {
+        seader_ccid_XfrBlockLevel(ccid, message->bSlot, NULL, 0, CCID_CHAIN_EMPTY);
+        return false;
+    }
 
-            return 2;
+    message->payload = ccid->rx_chain;
+    message->dwLength = ccid->rx_chain_len;
+    ccid->rx_chain_len = 0;
+    return true;
+}
+
+/* Drops a SAM that went away, the next conversation goes to another one if there is */
+static void seader_ccid_sam_removed(SeaderCcidContext* ccid, uint8_t slot) {
+    ccid->sams[slot].present = false;
+    ccid->sams[slot].power = SeaderSamPowerOn;
+    ccid->has_sam = false;
+    for(uint8_t i = 0; i < SEADER_CCID_SLOTS; i++) {
+        if(ccid->sams[i].present) {
+            ccid->has_sam = true;
+            if(!ccid->sams[ccid->sam_slot].present) {
+                ccid->sam_slot = i;
+            }
         }
     }
+}
 
-    while(cmd_len >= 3 && cmd[0] == SYNC && cmd[1] == NAK) {
-        // 031516
-        FURI_LOG_W(TAG, "NAK");
-        cmd += 3;
-        cmd_len -= 3;
-        message.consumed += 3;
+/* Moves the next conversation to slot, called off the worker so the move is left to it */
+void seader_ccid_select_slot(SeaderCcidContext* ccid, uint8_t slot) {
+    if(slot == ccid->sam_slot) {
+        return;
+    }
+    // Drop a release left over from a switch that was given up on
+    furi_semaphore_acquire(ccid->selected, 0);
+    ccid->select_slot = slot;
+    furi_thread_flags_set(furi_thread_get_id(ccid->uart->thread), WorkerEvtSamSelect);
+    // The first APDU of the conversation goes to sam_slot, so it has to be moved by then
+    if(furi_semaphore_acquire(ccid->selected, furi_ms_to_ticks(SEADER_CCID_CMD_TIMEOUT_MS)) !=
+       FuriStatusOk) {
+        FURI_LOG_W(TAG, "Slot %d not selected, staying on %d", slot, ccid->sam_slot);
+    }
+}
+
+/* Called on WorkerEvtSamSelect */
+void seader_ccid_select(SeaderCcidContext* ccid) {
+    uint8_t slot = ccid->select_slot;
+    // An APDU got in meanwhile, its answer is still owed on the current slot
+    if(!ccid->apdu_pending && ccid->sams[slot].present) {
+        ccid->sam_slot = slot;
+    }
+    furi_semaphore_release(ccid->selected);
+}
+
+/* The SAM in slot answered the APDU it was busy with */
+static void seader_ccid_sam_done(SeaderCcidContext* ccid, uint8_t slot) {
+    SeaderSam* sam = &ccid->sams[slot];
+    sam->busy_ms += furi_get_tick() - sam->busy_since;
+    sam->apdus++;
+}
+
+/* The SAM is back from a power off, the APDU that woke it goes out */
+static void seader_ccid_wake_done(SeaderCcidContext* ccid) {
+    SeaderUartState* st = &ccid->uart->st;
+    uint32_t latency = furi_get_tick() - ccid->wake_tick;
+
+    ccid->sams[ccid->chain_slot].power = SeaderSamPowerOn;
+    st->sam_wakes++;
+    st->wake_latency_last = latency;
+    st->wake_latency_max = MAX(st->wake_latency_max, latency);
+    if(latency > SEADER_SAM_WAKE_BUDGET_MS) {
+        FURI_LOG_W(TAG, "SAM woke in %ldms, over %dms", latency, SEADER_SAM_WAKE_BUDGET_MS);
+        st->wakes_over_budget++;
+    } else {
+        FURI_LOG_D(TAG, "SAM woke in %ldms", latency);
     }
 
-    while(cmd_len > 2 && (cmd[0] != SYNC || cmd[1] != CTRL)) {
-        FURI_LOG_W(TAG, "invalid start: %02x", cmd[0]);
-        cmd += 1;
-        cmd_len -= 1;
-        message.consumed += 1;
+    if(ccid->tx_chain_pos < ccid->tx_chain_len) {
+        seader_ccid_chain_next(ccid);
+    } else {
+        // Aborted while waking
+        ccid->apdu_pending = false;
+        seader_ccid_idle_restart(ccid);
     }
+}
+
+/*
+ * ATR of a SAM powered back on for an APDU. Version, serial number and the cached parameters
+ * still hold when it is the same SAM, false when a different one answered.
+ */
+static bool seader_ccid_wake(SeaderCcidContext* ccid, CCID_Message* message) {
+    SeaderAtr* atr = &ccid->atr[message->bSlot];
+    uint32_t hash = atr->hash;
 
-    if(cmd_len > 12 && cmd[0] == SYNC && cmd[1] == CTRL) {
-        uint8_t* ccid = cmd + 2;
-        message.bMessageType = ccid[0];
-        message.dwLength = *((uint32_t*)(ccid + 1));
-        message.bSlot = ccid[5];
-        message.bSeq = ccid[6];
-        message.bStatus = ccid[7];
-        message.bError = ccid[8];
-        message.payload = ccid + 10;
+    if(!seader_ccid_atr_parse(message->payload, message->dwLength, atr) || atr->hash != hash) {
+        FURI_LOG_W(TAG, "SAM changed while powered off, ATR %08lx now %08lx", hash, atr->hash);
+        seader_ccid_sam_removed(ccid, message->bSlot);
+        ccid->tx_chain_len = 0;
+        ccid->tx_chain_pos = 0;
+        ccid->apdu_pending = false;
+        return false;
+    }
+    if(ccid->uart->st.baudrate != SEADER_UART_BAUDRATE_DEFAULT) {
+        // The power on reset what was negotiated for the faster rate
+        ccid->sams[message->bSlot].power = SeaderSamPowerRestoring;
+        seader_ccid_SetParameters(ccid);
+        return true;
+    }
+    seader_ccid_wake_done(ccid);
+    return true;
+}
 
-        memset(display, 0, sizeof(display));
-        for(uint8_t i = 0; i < message.dwLength; i++) {
-            snprintf(display + (i * 2), sizeof(display), "%02x", message.payload[i]);
+/* The UI reports on the LPUART SAM, a second SAM only has to come up */
+static void seader_ccid_sam_ready(Seader* seader, SeaderCcidContext* ccid) {
+    seader_ccid_idle_restart(ccid);
+    if(ccid->uart == seader->uart) {
+        if(ccid->cache_hit && ccid->cache.version[0] != 0) {
+            // Known SAM, only its serial number is asked for
+            memcpy(seader->worker->sam_version, ccid->cache.version, sizeof(ccid->cache.version));
+            seader_worker_send_serial_number(seader);
+        } else {
+            seader_worker_send_version(seader);
         }
+    } else {
+        FURI_LOG_I(
+            TAG, "SAM %d ready in slot %d", ccid->uart->cfg.uart_ch, ccid->sam_slot);
+    }
+}
 
-        if(cmd_len < 2 + 10 + message.dwLength + 1) {
-            return message.consumed;
+static void
+    seader_ccid_notify(Seader* seader, SeaderCcidContext* ccid, SeaderWorkerEvent event) {
+    SeaderWorker* seader_worker = seader->worker;
+    if(ccid->uart == seader->uart && seader_worker->callback) {
+        seader_worker->callback(event, seader_worker->context);
+    }
+}
+
+/* A probed slot turned out not to hold a SAM, the verdict is reported once every slot has */
+static void seader_ccid_probe_done(Seader* seader, SeaderCcidContext* ccid, uint8_t slot) {
+    ccid->probing &= ~(1 << slot);
+    if(ccid->probing == 0 && !ccid->has_sam) {
+        seader_ccid_notify(
+            seader,
+            ccid,
+            ccid->probe_wrong ? SeaderWorkerEventSamWrong : SeaderWorkerEventSamMissing);
+    }
+}
+
+/* Outside a probe a failing slot means the SAM went away */
+static void seader_ccid_slot_failed(Seader* seader, SeaderCcidContext* ccid, uint8_t slot) {
+    if(slot < SEADER_CCID_SLOTS && ccid->sams[slot].present) {
+        ccid->sams[slot].errors++;
+    }
+    if(ccid->probing & (1 << slot)) {
+        seader_ccid_probe_done(seader, ccid, slot);
+    } else {
+        seader_ccid_notify(seader, ccid, SeaderWorkerEventSamMissing);
+    }
+}
+
+void seader_ccid_baudrate_start(Seader* seader, SeaderCcidContext* ccid) {
+    SeaderUartBridge* seader_uart = ccid->uart;
+    const SeaderAtr* atr = &ccid->atr[ccid->sam_slot];
+
+    // TA1 is present when bit 5 of T0 is set, SetParameters is only built for T=1
+    if(seader_uart->cfg.baudrate_mode != SeaderUartBaudrateModeNegotiate ||
+       !(atr->t0 & 0x10) || !(atr->protocols & (1 << 1))) {
+        seader_ccid_sam_ready(seader, ccid);
+        return;
+    }
+
+    seader_uart->baudrate_candidate = seader_ccid_baudrate_for_ta1(atr->ta1);
+    if(seader_uart->baudrate_candidate <= seader_uart->st.baudrate) {
+        seader_ccid_sam_ready(seader, ccid);
+        return;
+    }
+    if(ccid->cache_hit && ccid->cache.baudrate <= seader_uart->st.baudrate) {
+        FURI_LOG_I(TAG, "Negotiation failed for this SAM before, staying put");
+        seader_ccid_sam_ready(seader, ccid);
+        return;
+    }
+
+    FURI_LOG_I(TAG, "TA1 %02x, negotiating %ld baud", atr->ta1, seader_uart->baudrate_candidate);
+    seader_uart->baudrate_previous = seader_uart->st.baudrate;
+    seader_uart->baudrate_state = SeaderUartBaudrateStateParameters;
+    seader_ccid_SetParameters(ccid);
+}
+
+/* Moves our side of the link to the rate the reader was told to use and checks it */
+static void seader_ccid_baudrate_follow(
+    SeaderCcidContext* ccid,
+    uint32_t baudrate,
+    SeaderUartBaudrateState state) {
+    SeaderUartBridge* seader_uart = ccid->uart;
+
+    seader_uart->transport->set_baudrate(seader_uart, baudrate);
+    seader_uart->baudrate_state = state;
+    seader_ccid_GetSlotStatus(ccid, ccid->sam_slot);
+}
+
+void seader_ccid_baudrate_fallback(Seader* seader, SeaderCcidContext* ccid) {
+    SeaderUartBridge* seader_uart = ccid->uart;
+    uint32_t previous = seader_uart->baudrate_previous;
+
+    // Whatever was sent during the step that failed will not be answered
+    seader_ccid_pending_clear(ccid, ccid->sam_slot);
+    switch(seader_uart->baudrate_state) {
+    case SeaderUartBaudrateStateVerify:
+        // The reader moved but the link does not work, ask it to go back at the new rate
+        FURI_LOG_W(TAG, "No link at %ld baud, reverting", seader_uart->st.baudrate);
+        seader_uart->baudrate_state = SeaderUartBaudrateStateRevert;
+        seader_ccid_SetDataRateAndClockFrequency(ccid, previous);
+        break;
+    case SeaderUartBaudrateStateRevert:
+        // The answer may have been lost on the bad link, follow the reader back regardless
+        seader_ccid_baudrate_follow(ccid, previous, SeaderUartBaudrateStateRevertVerify);
+        break;
+    case SeaderUartBaudrateStateRevertVerify:
+        FURI_LOG_E(TAG, "Reader lost after reverting to %ld baud", previous);
+        seader_uart->baudrate_state = SeaderUartBaudrateStateIdle;
+        seader_ccid_notify(seader, ccid, SeaderWorkerEventSamMissing);
+        break;
+    default:
+        // The reader never switched, nothing to undo
+        FURI_LOG_W(TAG, "Baudrate negotiation failed, staying at %ld", previous);
+        seader_uart->baudrate_state = SeaderUartBaudrateStateIdle;
+        seader_ccid_sam_ready(seader, ccid);
+        break;
+    }
+    seader_ccid_arm_timer(ccid);
+}
+
+/* Returns true if the message was part of the negotiation */
+bool seader_ccid_baudrate_process(
+    Seader* seader,
+    SeaderCcidContext* ccid,
+    CCID_Message* message,
+    uint8_t lrc) {
+    SeaderUartBridge* seader_uart = ccid->uart;
+
+    if(seader_uart->baudrate_state == SeaderUartBaudrateStateIdle) {
+        return false;
+    }
+
+    if(message->bError != 0 || (message->bStatus >> 6) == COMMAND_STATUS_FAILED || lrc != 0) {
+        seader_ccid_baudrate_fallback(seader, ccid);
+        return true;
+    }
+
+    switch(seader_uart->baudrate_state) {
+    case SeaderUartBaudrateStateParameters:
+        if(message->bMessageType != CCID_MESSAGE_TYPE_RDR_to_PC_Parameters) {
+            return false;
         }
-        message.consumed += 2 + 10 + message.dwLength + 1;
-
-        /*
-        if(message.dwLength == 0) {
-            FURI_LOG_D(
-                TAG,
-                "CCID [%d|%d] type: %02x, status: %02x, error: %02x",
-                message.bSlot,
-                message.bSeq,
-                message.bMessageType,
-                message.bStatus,
-                message.bError);
-        } else {
-            FURI_LOG_D(
-                TAG,
-                "CCID [%d|%d] %ld: %s",
-                message.bSlot,
-                message.bSeq,
-                message.dwLength,
-                display);
-        }
-        */
-
-        //0306 81 00000000 0000 0200 01 87
-        //0306 81 00000000 0000 0100 01 84
-        if(message.bMessageType == CCID_MESSAGE_TYPE_RDR_to_PC_SlotStatus) {
-            uint8_t status = (message.bStatus & BMICCSTATUS_MASK);
-            if(status == 0 || status == 1) {
-                seader_ccid_IccPowerOn(seader_uart, message.bSlot);
-                return message.consumed;
-            } else if(status == 2) {
-                FURI_LOG_W(TAG, "No ICC is present [retries %d]", retries);
-                if(retries-- > 1 && hasSAM == false) {
-                    furi_delay_ms(100);
-                    seader_ccid_GetSlotStatus(seader_uart, retries % 2);
-                } else {
-                    if(seader_worker->callback) {
-                        seader_worker->callback(
-                            SeaderWorkerEventSamMissing, seader_worker->context);
-                    }
-                }
-                return message.consumed;
-            }
+        seader_uart->baudrate_state = SeaderUartBaudrateStateDataRate;
+        seader_ccid_SetDataRateAndClockFrequency(ccid, seader_uart->baudrate_candidate);
+        break;
+    case SeaderUartBaudrateStateDataRate:
+        if(message->bMessageType != CCID_MESSAGE_TYPE_RDR_to_PC_DataRateAndClockFrequency) {
+            return false;
+        }
+        // Reader has switched, follow it and check the link with a round trip
+        seader_ccid_baudrate_follow(
+            ccid, seader_uart->baudrate_candidate, SeaderUartBaudrateStateVerify);
+        break;
+    case SeaderUartBaudrateStateRevert:
+        if(message->bMessageType != CCID_MESSAGE_TYPE_RDR_to_PC_DataRateAndClockFrequency) {
+            return false;
+        }
+        seader_ccid_baudrate_follow(
+            ccid, seader_uart->baudrate_previous, SeaderUartBaudrateStateRevertVerify);
+        break;
+    case SeaderUartBaudrateStateVerify:
+    case SeaderUartBaudrateStateRevertVerify:
+        if(message->bMessageType != CCID_MESSAGE_TYPE_RDR_to_PC_SlotStatus) {
+            return false;
+        }
+        FURI_LOG_I(TAG, "Running at %ld baud", seader_uart->st.baudrate);
+        seader_uart->baudrate_state = SeaderUartBaudrateStateIdle;
+        seader_ccid_sam_ready(seader, ccid);
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+/* Called from the DMA callback, so it only looks at the header of the frame at the read cursor */
+bool seader_ccid_frame_ready(SeaderUartRing* ring) {
+    size_t cmd_len = seader_uart_ring_count(ring);
+    if(cmd_len < 2) {
+        return false;
+    }
+    if(seader_uart_ring_peek(ring, 0) != SYNC) {
+        // Slot change notification or garbage the parser needs to skip
+        return true;
+    }
+    uint8_t second = seader_uart_ring_peek(ring, 1);
+    if(second == NAK && cmd_len < 3) {
+        return false;
+    }
+    if(second != CTRL) {
+        // Only CTRL starts a frame, the parser takes a full 031516 as a NAK and steps over
+        // anything else
+        return true;
+    }
+    if(cmd_len < 2 + 5) {
+        return false;
+    }
+    uint32_t dwLength = seader_uart_ring_peek(ring, 3) | (seader_uart_ring_peek(ring, 4) << 8) |
+                        (seader_uart_ring_peek(ring, 5) << 16) |
+                        ((uint32_t)seader_uart_ring_peek(ring, 6) << 24);
+    return cmd_len >= 2 + 10 + dwLength + 1;
+}
+
+static void seader_ccid_slot_change(SeaderCcidContext* ccid, uint8_t slot_change) {
+    switch(slot_change & SLOT_0_MASK) {
+    case 0:
+    case 1:
+        // No change, no-op
+        break;
+    case CARD_IN_1:
+        FURI_LOG_D(TAG, "Card Inserted (0)");
+        if(ccid->sams[0].present) {
+            break;
+        }
+        ccid->sequence[0] = 0;
+        seader_ccid_IccPowerOn(ccid, 0);
+        break;
+    case CARD_OUT_1:
+        FURI_LOG_D(TAG, "Card Removed (0)");
+        seader_ccid_pending_clear(ccid, 0);
+        if(ccid->sams[0].present) {
+            ccid->powered[0] = false;
+            seader_ccid_sam_removed(ccid, 0);
         }
+        break;
+    };
 
-        //0306 80 00000000 0001 42fe 00 38
-        if(message.bStatus == 0x41 && message.bError == 0xfe) {
-            FURI_LOG_W(TAG, "card probably upside down");
-            if(seader_worker->callback) {
-                seader_worker->callback(SeaderWorkerEventSamMissing, seader_worker->context);
+    switch(slot_change & SLOT_1_MASK) {
+    case 0:
+    case 1:
+        // No change, no-op
+        break;
+    case CARD_IN_2:
+        FURI_LOG_D(TAG, "Card Inserted (1)");
+        if(ccid->sams[1].present) {
+            break;
+        }
+        ccid->sequence[1] = 0;
+        seader_ccid_IccPowerOn(ccid, 1);
+        break;
+    case CARD_OUT_2:
+        FURI_LOG_D(TAG, "Card Removed (1)");
+        seader_ccid_pending_clear(ccid, 1);
+        if(ccid->sams[1].present) {
+            ccid->powered[1] = false;
+            seader_ccid_sam_removed(ccid, 1);
+        }
+        break;
+    };
+}
+
+/* Handles one complete frame of message->consumed bytes, message->payload points into it */
+static void seader_ccid_frame(
+    Seader* seader,
+    SeaderCcidContext* ccid,
+    CCID_Message* message,
+    uint8_t* frame) {
+    SeaderUartBridge* seader_uart = ccid->uart;
+
+    // XOR over the whole frame, LRC included, is 0 when it arrived intact
+    uint8_t lrc = seader_ccid_lrc(frame, message->consumed);
+    if(lrc != 0) {
+        if(seader_ccid_baudrate_process(seader, ccid, message, lrc)) {
+            // A wrong baudrate shows up as a bad LRC, the negotiation falls back on it
+            return;
+        }
+        // Nothing in a corrupted frame can be trusted, bSeq included, so ask again
+        FURI_LOG_W(TAG, "Bad LRC, slot %d seq %d", message->bSlot, message->bSeq);
+        seader_uart->st.lrc_errors++;
+        seader_ccid_resend(ccid);
+        return;
+    }
+
+    uint8_t command_status = message->bStatus >> 6;
+    if(command_status == COMMAND_STATUS_TIME_EXTENSION_REQUIRED) {
+        // The SAM is still working, bError is the multiplier of the waiting time it asks for
+        FURI_LOG_D(TAG, "Time extension x%d, slot %d", message->bError, message->bSlot);
+        if(seader_ccid_defer(ccid, message, message->bError)) {
+            seader_uart->st.time_extensions++;
+        }
+        return;
+    }
+    if(command_status == COMMAND_STATUS_FAILED) {
+        int8_t error = (int8_t)message->bError;
+        if(error == ERROR_XFR_PARITY_ERROR || error == ERROR_XFR_OVERRUN) {
+            // Lost between the reader and the SAM, the command itself is fine
+            FURI_LOG_W(TAG, "Transfer error %02x, slot %d", message->bError, message->bSlot);
+            if(seader_ccid_retransmit(ccid, message->bSlot)) {
+                seader_uart->st.recovered_errors++;
             }
-            return message.consumed;
+            return;
         }
-        if(message.bStatus == 0x42 && message.bError == 0xfe) {
-            FURI_LOG_W(TAG, "No card");
-            if(seader_worker->callback) {
-                seader_worker->callback(SeaderWorkerEventSamMissing, seader_worker->context);
+        if(error == ERROR_CMD_SLOT_BUSY) {
+            // Sent again from the deadline once the slot had time to finish
+            FURI_LOG_W(TAG, "Slot %d busy", message->bSlot);
+            if(seader_ccid_defer(ccid, message, 1)) {
+                seader_uart->st.recovered_errors++;
             }
-            return message.consumed;
+            return;
+        }
+    }
+
+    uint32_t sent_tick;
+    if(!seader_ccid_match(ccid, message, &sent_tick)) {
+        // A late answer to a command that was since retransmitted or dropped
+        return;
+    }
+    if(seader_ccid_baudrate_process(seader, ccid, message, lrc)) {
+        return;
+    }
+
+    if(ccid->sams[message->bSlot].power == SeaderSamPowerRestoring &&
+       message->bMessageType == CCID_MESSAGE_TYPE_RDR_to_PC_Parameters) {
+        if(message->bError != 0) {
+            FURI_LOG_W(TAG, "SetParameters after wake failed: %02x", message->bError);
+        }
+        seader_ccid_wake_done(ccid);
+        return;
+    }
+
+    if(ccid->aborting && message->bMessageType == CCID_MESSAGE_TYPE_RDR_to_PC_SlotStatus) {
+        if(message->bError != 0) {
+            FURI_LOG_W(TAG, "Abort answered with error %02x", message->bError);
         }
-        if(message.bError != 0) {
-            FURI_LOG_W(TAG, "CCID error %02x", message.bError);
-            message.consumed = cmd_len;
-            if(seader_worker->callback) {
-                seader_worker->callback(SeaderWorkerEventSamMissing, seader_worker->context);
+        FURI_LOG_I(TAG, "SAM idle after abort");
+        ccid->aborting = false;
+        ccid->apdu_pending = false;
+        return;
+    }
+
+    //0306 81 00000000 0000 0200 01 87
+    //0306 81 00000000 0000 0100 01 84
+    if(message->bMessageType == CCID_MESSAGE_TYPE_RDR_to_PC_SlotStatus) {
+        uint8_t status = (message->bStatus & BMICCSTATUS_MASK);
+        if(status == 0 || status == 1) {
+            if(!ccid->sams[message->bSlot].present) {
+                seader_ccid_IccPowerOn(ccid, message->bSlot);
             }
-            return message.consumed;
+            return;
+        } else if(status == 2) {
+            // A SAM inserted later is powered on from its NotifySlotChange
+            FURI_LOG_W(TAG, "No ICC is present (%d)", message->bSlot);
+            seader_ccid_slot_failed(seader, ccid, message->bSlot);
+            return;
         }
+    }
+
+    //0306 80 00000000 0001 42fe 00 38
+    if(message->bStatus == 0x41 && message->bError == 0xfe) {
+        FURI_LOG_W(TAG, "card probably upside down");
+        seader_ccid_slot_failed(seader, ccid, message->bSlot);
+        return;
+    }
+    if(message->bStatus == 0x42 && message->bError == 0xfe) {
+        FURI_LOG_W(TAG, "No card");
+        seader_ccid_slot_failed(seader, ccid, message->bSlot);
+        return;
+    }
+    if(message->bError != 0) {
+        FURI_LOG_W(TAG, "CCID error %02x", message->bError);
+        seader_ccid_slot_failed(seader, ccid, message->bSlot);
+        return;
+    }
 
-        if(message.bMessageType == CCID_MESSAGE_TYPE_RDR_to_PC_DataBlock) {
-            if(hasSAM) {
-                if(message.bSlot == sam_slot) {
-                    seader_worker_process_sam_message(seader, &message);
-                } else {
-                    FURI_LOG_D(TAG, "Discarding message on non-sam slot");
+    if(message->bMessageType == CCID_MESSAGE_TYPE_RDR_to_PC_DataBlock) {
+        SeaderSam* sam = &ccid->sams[message->bSlot];
+        if(sam->present && sam->power == SeaderSamPowerWaking &&
+           seader_ccid_wake(ccid, message)) {
+            return;
+        }
+        // A different SAM that answered a wake is brought up like a new one below
+        if(sam->present) {
+            if(!seader_ccid_chain(ccid, message)) {
+                return;
+            }
+            ccid->apdu_pending = false;
+            seader_ccid_sam_done(ccid, message->bSlot);
+            seader_uart_record_latency(seader_uart, sent_tick);
+            seader_ccid_idle_restart(ccid);
+            seader_worker_process_sam_message(seader, seader_uart, message);
+        } else {
+            SeaderAtr* atr = &ccid->atr[message->bSlot];
+            bool valid = seader_ccid_atr_parse(message->payload, message->dwLength, atr);
+            // The menu comes up on the ATR, version and serial number follow in the background
+            if(valid && seader_ccid_atr_is_sam(atr)) {
+                FURI_LOG_I(
+                    TAG,
+                    "SAM ATR %08lx (%d): TA1 %02x, protocols %04x, IFSC %d",
+                    atr->hash,
+                    message->bSlot,
+                    atr->ta1,
+                    atr->protocols,
+                    atr->ifsc);
+                sam->present = true;
+                sam->power = SeaderSamPowerOn;
+                ccid->probing &= ~(1 << message->bSlot);
+                if(ccid->has_sam) {
+                    // Version and rate came from the first one, this one only takes conversations
+                    FURI_LOG_I(TAG, "Another SAM in slot %d", message->bSlot);
+                    return;
                 }
+                ccid->has_sam = true;
+                ccid->sam_slot = message->bSlot;
+                ccid->cache_hit = seader_sam_cache_lookup(seader, atr->hash, &ccid->cache);
+                seader_ccid_notify(seader, ccid, SeaderWorkerEventSamPresent);
+                seader_ccid_baudrate_start(seader, ccid);
+            } else if(ccid->probing & (1 << message->bSlot)) {
+                FURI_LOG_W(TAG, "Unknown ATR (%d)", message->bSlot);
+                ccid->probe_wrong = true;
+                seader_ccid_probe_done(seader, ccid, message->bSlot);
+            } else if(!ccid->has_sam) {
+                FURI_LOG_W(TAG, "Unknown ATR");
+                seader_ccid_notify(seader, ccid, SeaderWorkerEventSamWrong);
             } else {
-                if(memcmp(SAM_ATR, message.payload, sizeof(SAM_ATR)) == 0) {
-                    FURI_LOG_I(TAG, "SAM ATR!");
-                    hasSAM = true;
-                    sam_slot = message.bSlot;
-                    seader_worker_send_version(seader);
-                    if(seader_worker->callback) {
-                        seader_worker->callback(
-                            SeaderWorkerEventSamPresent, seader_worker->context);
-                    }
-                } else if(memcmp(SAM_ATR2, message.payload, sizeof(SAM_ATR2)) == 0) {
-                    FURI_LOG_I(TAG, "SAM ATR2!");
-                    hasSAM = true;
-                    sam_slot = message.bSlot;
-                    seader_worker_send_version(seader);
-                    if(seader_worker->callback) {
-                        seader_worker->callback(
-                            SeaderWorkerEventSamPresent, seader_worker->context);
-                    }
-                } else {
-                    FURI_LOG_W(TAG, "Unknown ATR");
-                    if(seader_worker->callback) {
-                        seader_worker->callback(SeaderWorkerEventSamWrong, seader_worker->context);
+                FURI_LOG_W(TAG, "Unknown ATR (%d), not a SAM", message->bSlot);
+            }
+        }
+    } else {
+        FURI_LOG_W(TAG, "Unhandled CCID message type %d", message->bMessageType);
+    }
+}
+
+/*
+ * Streaming parser over rx_ring, returns the bytes it is done with or 0 when it needs more.
+ * Where a frame starts and how long it is are kept in ccid between calls, so a partial frame
+ * is not parsed again on every wakeup. Notifications and NAKs are picked up wherever they
+ * fall between frames.
+ */
+size_t seader_ccid_process(Seader* seader, SeaderCcidContext* ccid) {
+    SeaderUartBridge* seader_uart = ccid->uart;
+    SeaderUartRing* ring = &seader_uart->rx_ring;
+    size_t cmd_len = seader_uart_ring_count(ring);
+
+    if(ccid->parse_tail != ring->tail) {
+        // Bytes were consumed or flushed since the last call, the next one starts a frame
+        ccid->parse_state = SeaderCcidParseStart;
+        ccid->parse_tail = ring->tail;
+    }
+
+    while(1) {
+        switch(ccid->parse_state) {
+        case SeaderCcidParseStart: {
+            size_t skipped = 0;
+            while(skipped < cmd_len) {
+                uint8_t b = seader_uart_ring_peek(ring, skipped);
+                if(b == SYNC || b == CCID_MESSAGE_TYPE_RDR_to_PC_NotifySlotChange) {
+                    break;
+                }
+                skipped++;
+            }
+            if(skipped > 0) {
+                FURI_LOG_W(TAG, "Skipped %d bytes looking for a frame", skipped);
+                seader_uart->st.skipped_bytes += skipped;
+                return skipped;
+            }
+            if(cmd_len < 2) {
+                return 0;
+            }
+
+            uint8_t second = seader_uart_ring_peek(ring, 1);
+            if(seader_uart_ring_peek(ring, 0) == CCID_MESSAGE_TYPE_RDR_to_PC_NotifySlotChange) {
+                // bmSlotICCState only has bits for our two slots
+                if((second & 0xf0) == 0) {
+                    seader_ccid_slot_change(ccid, second);
+                    return 2;
+                }
+            } else if(second == CTRL) {
+                ccid->parse_state = SeaderCcidParseHeader;
+                break;
+            } else if(second == NAK) {
+                if(cmd_len < 3) {
+                    return 0;
+                }
+                // 031516, a SYNC NAK with anything else behind it is noise
+                if(seader_uart_ring_peek(ring, 2) == NAK_END) {
+                    FURI_LOG_W(TAG, "NAK");
+                    if(seader_uart->baudrate_state != SeaderUartBaudrateStateIdle) {
+                        seader_ccid_baudrate_fallback(seader, ccid);
+                    } else if(seader_ccid_retransmit(ccid, seader_ccid_last_slot(ccid))) {
+                        seader_uart->st.nak_resends++;
                     }
+                    return 3;
                 }
             }
-        } else {
-            FURI_LOG_W(TAG, "Unhandled CCID message type %d", message.bMessageType);
+            // Looked like a start but is not one
+            seader_uart->st.skipped_bytes++;
+            return 1;
         }
-    }
+        case SeaderCcidParseHeader: {
+            if(cmd_len < 2 + 10) {
+                return 0;
+            }
+            uint32_t dwLength = seader_uart_ring_peek(ring, 2 + 1) |
+                                (seader_uart_ring_peek(ring, 2 + 2) << 8) |
+                                (seader_uart_ring_peek(ring, 2 + 3) << 16) |
+                                ((uint32_t)seader_uart_ring_peek(ring, 2 + 4) << 24);
+            if(dwLength + SEADER_CCID_FRAME_OVERHEAD > SEADER_UART_RX_BUF_SIZE) {
+                // Most likely a corrupted header, step over its SYNC/CTRL and hunt for the
+                // next frame instead of throwing away what follows
+                FURI_LOG_W(TAG, "OVERFLOW: %ld", dwLength);
+                return 2;
+            }
+            ccid->frame_len = 2 + 10 + dwLength + 1;
+            ccid->parse_state = SeaderCcidParseBody;
+            break;
+        }
+        case SeaderCcidParseBody: {
+            if(cmd_len < ccid->frame_len) {
+                return 0;
+            }
+            uint8_t* frame = seader_uart_ring_get(ring, 0, ccid->frame_len, seader_uart->rx_buf);
+            CCID_Message message;
+            message.bMessageType = frame[2 + 0];
+            message.dwLength = ccid->frame_len - SEADER_CCID_FRAME_OVERHEAD;
+            message.bSlot = frame[2 + 5];
+            message.bSeq = frame[2 + 6];
+            message.bStatus = frame[2 + 7];
+            message.bError = frame[2 + 8];
+            message.bChainParameter = frame[2 + 9];
+            message.payload = frame + 2 + 10;
+            message.consumed = ccid->frame_len;
 
-    return message.consumed;
+            seader_ccid_frame(seader, ccid, &message, frame);
+            return message.consumed;
+        }
+        }
+    }
 }
@@ -12,6 +12,8 @@
 #define SYNC (0x03)
 #define CTRL (0x06)
 #define NAK (0x15)
+// Third byte of a NAK, SYNC NAK NAK_END
+#define NAK_END (0x16)
 
 #define BMICCSTATUS_MASK 0x03
 /*
@@ -56,6 +58,15 @@
 #define CCID_MESSAGE_TYPE_RDR_to_PC_Parameters 0x82
 #define CCID_MESSAGE_TYPE_RDR_to_PC_Escape 0x83
 #define CCID_MESSAGE_TYPE_RDR_to_PC_DataRateAndClockFrequency 0x84
+
+/* wLevelParameter of an XfrBlock and bChainParameter of a DataBlock (see 6.1.4 and 6.2.1) */
+#define CCID_CHAIN_NONE 0x00
+#define CCID_CHAIN_BEGIN 0x01
+#define CCID_CHAIN_END 0x02
+#define CCID_CHAIN_CONTINUE 0x03
+// Empty block, asks for (XfrBlock) or announces (DataBlock) the next one
+#define CCID_CHAIN_EMPTY 0x10
+
 /*
  *  * INTERRUPT_IN messages from Reader to PC
  *   * Defined in CCID Rev 1.1 6.3 (page 56)
@@ -78,6 +89,7 @@ enum {
     ERROR_XFR_PARITY_ERROR = -3,
     ERROR_XFR_OVERRUN = -4,
     ERROR_HW_ERROR = -5,
+    ERROR_CMD_SLOT_BUSY = -32,
 };
 
 struct CCID_Message {
@@ -87,20 +99,41 @@ struct CCID_Message {
     uint8_t bSeq;
     uint8_t bStatus;
     uint8_t bError;
+    uint8_t bChainParameter;
 
     uint8_t* payload;
     size_t consumed;
 };
 
-void seader_ccid_check_for_sam(SeaderUartBridge* seader_uart);
-void seader_ccid_IccPowerOn(SeaderUartBridge* seader_uart, uint8_t slot);
-void seader_ccid_GetSlotStatus(SeaderUartBridge* seader_uart, uint8_t slot);
-void seader_ccid_SetParameters(SeaderUartBridge* seader_uart);
-void seader_ccid_GetParameters(SeaderUartBridge* seader_uart);
-void seader_ccid_XfrBlock(SeaderUartBridge* seader_uart, uint8_t* data, size_t len);
+void seader_ccid_context_init(SeaderCcidContext* ccid, SeaderUartBridge* seader_uart);
+void seader_ccid_context_free(SeaderCcidContext* ccid);
+uint8_t seader_ccid_lrc(const uint8_t* data, size_t len);
+void seader_ccid_check_for_sam(SeaderCcidContext* ccid);
+void seader_ccid_IccPowerOn(SeaderCcidContext* ccid, uint8_t slot);
+void seader_ccid_IccPowerOff(SeaderCcidContext* ccid, uint8_t slot);
+void seader_ccid_GetSlotStatus(SeaderCcidContext* ccid, uint8_t slot);
+void seader_ccid_SetParameters(SeaderCcidContext* ccid);
+void seader_ccid_SetDataRateAndClockFrequency(SeaderCcidContext* ccid, uint32_t baudrate);
+void seader_ccid_GetParameters(SeaderCcidContext* ccid);
+void seader_ccid_XfrBlock(SeaderCcidContext* ccid, uint8_t* data, size_t len);
+void seader_ccid_Abort(SeaderCcidContext* ccid);
+// Frame to write an APDU into at SEADER_CCID_HEADER_LEN, XfrBlockSend puts the header in
+// front of it. Has to be sent, a len of 0 gives it back unsent.
+uint8_t* seader_ccid_XfrBlockAcquire(SeaderCcidContext* ccid);
+void seader_ccid_XfrBlockSend(SeaderCcidContext* ccid, uint8_t* tx_buf, size_t len);
 void seader_ccid_XfrBlockToSlot(
-    SeaderUartBridge* seader_uart,
+    SeaderCcidContext* ccid,
     uint8_t slot,
     uint8_t* data,
     size_t len);
-size_t seader_ccid_process(Seader* seader, uint8_t* cmd, size_t cmd_len);
+bool seader_ccid_atr_parse(const uint8_t* atr, size_t len, SeaderAtr* out);
+uint32_t seader_ccid_baudrate_for_ta1(uint8_t ta1);
+void seader_ccid_baudrate_start(Seader* seader, SeaderCcidContext* ccid);
+void seader_ccid_baudrate_fallback(Seader* seader, SeaderCcidContext* ccid);
+bool seader_ccid_frame_ready(SeaderUartRing* ring);
+size_t seader_ccid_process(Seader* seader, SeaderCcidContext* ccid);
+void seader_ccid_resend(SeaderCcidContext* ccid);
+void seader_ccid_timeout(SeaderCcidContext* ccid);
+void seader_ccid_idle(SeaderCcidContext* ccid);
+void seader_ccid_select_slot(SeaderCcidContext* ccid, uint8_t slot);
+void seader_ccid_select(SeaderCcidContext* ccid);
@@ -1,5 +1,6 @@
 
 #include "sam_api.h"
+#include "sam_der.h"
 #include <toolbox/path.h>
 #include <bit_lib/bit_lib.h>
 
@@ -7,15 +8,16 @@
 
 #define APDU_HEADER_LEN 5
 #define ASN1_PREFIX 6
-#define ASN1_DEBUG true
+// Where a Payload's DER starts in the TX frame, behind the CCID header, the APDU header and the
+// to/from/replyTo prefix, and how much of it fits in SEADER_APDU_MAX_LEN
+#define SEADER_PAYLOAD_OFFSET (SEADER_CCID_HEADER_LEN + APDU_HEADER_LEN + ASN1_PREFIX)
+#define SEADER_PAYLOAD_MAX_LEN (SEADER_APDU_MAX_LEN - APDU_HEADER_LEN - ASN1_PREFIX)
 #define SEADER_ICLASS_SR_SIO_BASE_BLOCK 10
 #define SEADER_SERIAL_FILE_NAME "sam_serial"
+#define SEADER_SAM_CACHE_PATH APP_DATA_PATH("sam_cache.txt")
 
 const uint8_t picopass_iclass_key[] = {0xaf, 0xa7, 0x85, 0xa7, 0xda, 0xb3, 0x33, 0x78};
 
-static char display[SEADER_UART_RX_BUF_SIZE * 2 + 1] = {0};
-char asn1_log[SEADER_UART_RX_BUF_SIZE] = {0};
-
 uint8_t read4Block6[] = {RFAL_PICOPASS_CMD_READ4, 0x06, 0x45, 0x56};
 uint8_t read4Block9[] = {RFAL_PICOPASS_CMD_READ4, 0x09, 0xB2, 0xAE};
 uint8_t read4Block10[] = {RFAL_PICOPASS_CMD_READ4, 0x0A, 0x29, 0x9C};
@@ -28,13 +30,36 @@ uint8_t ev2_request[] =
     {0x00, 0xa4, 0x04, 0x00, 0x0a, 0xa0, 0x00, 0x00, 0x04, 0x40, 0x00, 0x01, 0x01, 0x00, 0x01, 0x00};
 uint8_t FILE_NOT_FOUND[] = {0x6a, 0x82};
 
+#if SEADER_DER_CARD_DETECTED_MAX > SEADER_PAYLOAD_MAX_LEN
+#error "cardDetected has to fit in SEADER_APDU_MAX_LEN"
+#endif
+
+// asn1c allocates through calloc, counted so the TX path can show it stays off the heap
+static volatile uint32_t seader_calloc_count = 0;
+
 void* calloc(size_t count, size_t size) {
-    return malloc(count * size);
+    seader_calloc_count++;
+    void* ptr = malloc(count * size);
+    // asn1c expects zeroed memory, which malloc does not promise
+    memset(ptr, 0, count * size);
+    return ptr;
 }
 
 // Forward declarations
 void seader_send_nfc_rx(SeaderUartBridge* seader_uart, uint8_t* buffer, size_t len);
 
+/* Hex dump buffer of the calling thread, each UART worker has its own next to the NFC side's */
+static char* seader_display(Seader* seader) {
+    FuriThreadId current = furi_thread_get_current_id();
+    SeaderUartBridge* bridges[] = {seader->uart, seader->uart2};
+    for(size_t i = 0; i < COUNT_OF(bridges); i++) {
+        if(bridges[i] && furi_thread_get_id(bridges[i]->thread) == current) {
+            return bridges[i]->display;
+        }
+    }
+    return seader->worker->display;
+}
+
 PicopassError seader_worker_fake_epurse_update(BitBuffer* tx_buffer, BitBuffer* rx_buffer) {
     const uint8_t* buffer = bit_buffer_get_data(tx_buffer);
     uint8_t fake_response[8];
@@ -45,9 +70,14 @@ PicopassError seader_worker_fake_epurse_update(BitBuffer* tx_buffer, BitBuffer*
     bit_buffer_append_bytes(rx_buffer, fake_response, sizeof(fake_response));
     iso13239_crc_append(Iso13239CrcTypePicopass, rx_buffer);
 
-    memset(display, 0, sizeof(display));
+    // The response and its CRC
+    char display[(sizeof(fake_response) + 2) * 2 + 1] = {0};
     for(uint8_t i = 0; i < bit_buffer_get_size_bytes(rx_buffer); i++) {
-        snprintf(display + (i * 2), sizeof(display), "%02x", bit_buffer_get_data(rx_buffer)[i]);
+        snprintf(
+            display + (i * 2),
+            sizeof(display) - (i * 2),
+            "%02x",
+            bit_buffer_get_data(rx_buffer)[i]);
     }
     FURI_LOG_I(TAG, "Fake update E-Purse response: %s", display);
 
@@ -139,81 +169,137 @@ void seader_picopass_state_machine(Seader* seader, uint8_t* buffer, size_t len)
     bit_buffer_free(rx_buffer);
 }
 
-bool seader_send_apdu(
+/*
+ * Puts the APDU header in front of the length bytes written at
+ * SEADER_CCID_HEADER_LEN + APDU_HEADER_LEN of a frame from seader_ccid_XfrBlockAcquire
+ */
+static bool seader_send_apdu_frame(
     SeaderUartBridge* seader_uart,
+    uint8_t* frame,
     uint8_t CLA,
     uint8_t INS,
     uint8_t P1,
     uint8_t P2,
-    uint8_t* payload,
-    uint8_t length) {
-    if(APDU_HEADER_LEN + length > SEADER_UART_RX_BUF_SIZE) {
+    size_t length) {
+    char* display = seader_display(seader_uart->seader);
+    uint8_t* apdu = frame + SEADER_CCID_HEADER_LEN;
+    // Short APDUs only, Lc is a single byte
+    if(length > 0xff || APDU_HEADER_LEN + length > SEADER_APDU_MAX_LEN) {
         FURI_LOG_E(TAG, "Cannot send message, too long: %d", APDU_HEADER_LEN + length);
+        seader_ccid_XfrBlockSend(&seader_uart->ccid, frame, 0);
         return false;
     }
 
-    uint8_t apdu[SEADER_UART_RX_BUF_SIZE];
     apdu[0] = CLA;
     apdu[1] = INS;
     apdu[2] = P1;
     apdu[3] = P2;
     apdu[4] = length;
-    memcpy(apdu + APDU_HEADER_LEN, payload, length);
 
-    memset(display, 0, sizeof(display));
-    for(uint8_t i = 0; i < APDU_HEADER_LEN + length; i++) {
-        snprintf(display + (i * 2), sizeof(display), "%02x", apdu[i]);
+    memset(display, 0, SEADER_DISPLAY_LEN);
+    for(size_t i = 0; i < APDU_HEADER_LEN + length; i++) {
+        snprintf(display + (i * 2), SEADER_DISPLAY_LEN - (i * 2), "%02x", apdu[i]);
     }
     FURI_LOG_D(TAG, "seader_send_apdu %s", display);
 
-    seader_ccid_XfrBlock(seader_uart, apdu, APDU_HEADER_LEN + length);
+    seader_ccid_XfrBlockSend(&seader_uart->ccid, frame, APDU_HEADER_LEN + length);
     return true;
 }
 
-static int seader_print_struct_callback(const void* buffer, size_t size, void* app_key) {
-    if(app_key) {
-        char* str = (char*)app_key;
-        size_t next = strlen(str);
-        strncpy(str + next, buffer, size);
-    } else {
-        uint8_t next = strlen(asn1_log);
-        strncpy(asn1_log + next, buffer, size);
+bool seader_send_apdu(
+    SeaderUartBridge* seader_uart,
+    uint8_t CLA,
+    uint8_t INS,
+    uint8_t P1,
+    uint8_t P2,
+    uint8_t* payload,
+    size_t length) {
+    if(APDU_HEADER_LEN + length > SEADER_APDU_MAX_LEN) {
+        FURI_LOG_E(TAG, "Cannot send message, too long: %d", APDU_HEADER_LEN + length);
+        return false;
     }
+
+    uint8_t* frame = seader_ccid_XfrBlockAcquire(&seader_uart->ccid);
+    memcpy(frame + SEADER_CCID_HEADER_LEN + APDU_HEADER_LEN, payload, length);
+    return seader_send_apdu_frame(seader_uart, frame, CLA, INS, P1, P2, length);
+}
+
+static int seader_print_struct_callback(const void* buffer, size_t size, void* app_key) {
+    char* str = (char*)app_key;
+    size_t next = strlen(str);
+    strncpy(str + next, buffer, size);
     return 0;
 }
 
+/* The ASN.1 and hex dumps only feed FURI_LOG_D, they are skipped when it is filtered out */
+static bool seader_debug_log(void) {
+    return furi_log_get_level() >= FuriLogLevelDebug;
+}
+
+/* print_struct into a size byte buffer off the stack, free it once logged */
+static char* seader_print_struct(asn_TYPE_descriptor_t* td, const void* sptr, size_t size) {
+    char* str = calloc(1, size);
+    td->op->print_struct(td, sptr, 1, seader_print_struct_callback, str);
+    return str;
+}
+
+/* Fills in the prefix in front of der_len bytes of DER at SEADER_PAYLOAD_OFFSET and sends */
+static void seader_send_payload_frame(
+    SeaderUartBridge* seader_uart,
+    uint8_t* frame,
+    size_t der_len,
+    uint8_t to,
+    uint8_t from,
+    uint8_t replyTo) {
+    //0xa0, 0xda, 0x02, 0x63, 0x00, 0x00, 0x0a,
+    //0x44, 0x0a, 0x44, 0x00, 0x00, 0x00, 0xa0, 0x02, 0x96, 0x00
+    uint8_t* prefix = frame + SEADER_PAYLOAD_OFFSET - ASN1_PREFIX;
+    prefix[0] = to;
+    prefix[1] = from;
+    prefix[2] = replyTo;
+    memset(prefix + 3, 0, ASN1_PREFIX - 3);
+
+    seader_send_apdu_frame(seader_uart, frame, 0xA0, 0xDA, 0x02, 0x63, ASN1_PREFIX + der_len);
+}
+
 void seader_send_payload(
     SeaderUartBridge* seader_uart,
     Payload_t* payload,
     uint8_t to,
     uint8_t from,
     uint8_t replyTo) {
-    uint8_t rBuffer[SEADER_UART_RX_BUF_SIZE] = {0};
-
+    // Encoded straight into the TX frame, the headers are filled in around it
+    uint8_t* frame = seader_ccid_XfrBlockAcquire(&seader_uart->ccid);
     asn_enc_rval_t er = der_encode_to_buffer(
-        &asn_DEF_Payload, payload, rBuffer + ASN1_PREFIX, sizeof(rBuffer) - ASN1_PREFIX);
-
-#ifdef ASN1_DEBUG
-    if(er.encoded > -1) {
-        char payloadDebug[1024] = {0};
-        memset(payloadDebug, 0, sizeof(payloadDebug));
-        (&asn_DEF_Payload)
-            ->op->print_struct(
-                &asn_DEF_Payload, payload, 1, seader_print_struct_callback, payloadDebug);
+        &asn_DEF_Payload, payload, frame + SEADER_PAYLOAD_OFFSET, SEADER_PAYLOAD_MAX_LEN);
+    if(er.encoded < 0) {
+        FURI_LOG_E(TAG, "Failed to encode payload");
+        seader_ccid_XfrBlockSend(&seader_uart->ccid, frame, 0);
+        return;
+    }
+
+    if(seader_debug_log()) {
+        char* payloadDebug = seader_print_struct(&asn_DEF_Payload, payload, 1024);
         if(strlen(payloadDebug) > 0) {
             FURI_LOG_D(TAG, "Sending payload[%d %d %d]: %s", to, from, replyTo, payloadDebug);
         }
-    } else {
-        FURI_LOG_W(TAG, "Failed to print_struct payload");
+        free(payloadDebug);
     }
-#endif
-    //0xa0, 0xda, 0x02, 0x63, 0x00, 0x00, 0x0a,
-    //0x44, 0x0a, 0x44, 0x00, 0x00, 0x00, 0xa0, 0x02, 0x96, 0x00
-    rBuffer[0] = to;
-    rBuffer[1] = from;
-    rBuffer[2] = replyTo;
 
-    seader_send_apdu(seader_uart, 0xA0, 0xDA, 0x02, 0x63, rBuffer, 6 + er.encoded);
+    seader_send_payload_frame(seader_uart, frame, er.encoded, to, from, replyTo);
+}
+
+/* Sends an already encoded Payload behind the to/from/replyTo prefix */
+static void seader_send_der(
+    SeaderUartBridge* seader_uart,
+    const uint8_t* der,
+    size_t len,
+    uint8_t to,
+    uint8_t from,
+    uint8_t replyTo) {
+    uint8_t* frame = seader_ccid_XfrBlockAcquire(&seader_uart->ccid);
+    memcpy(frame + SEADER_PAYLOAD_OFFSET, der, len);
+    seader_send_payload_frame(seader_uart, frame, len, to, from, replyTo);
 }
 
 void seader_send_response(
@@ -222,132 +308,64 @@ void seader_send_response(
     uint8_t to,
     uint8_t from,
     uint8_t replyTo) {
-    Payload_t* payload = 0;
-    payload = calloc(1, sizeof *payload);
-    assert(payload);
-
-    payload->present = Payload_PR_response;
-    payload->choice.response = *response;
-
-    seader_send_payload(seader_uart, payload, to, from, replyTo);
-
-    ASN_STRUCT_FREE(asn_DEF_Payload, payload);
+    // The encoder only reads the tree, so it lives on the stack
+    Payload_t payload = {.present = Payload_PR_response, .choice.response = *response};
+    seader_send_payload(seader_uart, &payload, to, from, replyTo);
 }
 
 void seader_send_request_pacs(Seader* seader) {
     SeaderWorker* seader_worker = seader->worker;
     SeaderUartBridge* seader_uart = seader_worker->uart;
 
-    RequestPacs_t* requestPacs = 0;
-    requestPacs = calloc(1, sizeof *requestPacs);
-    assert(requestPacs);
-
-    requestPacs->contentElementTag = ContentElementTag_implicitFormatPhysicalAccessBits;
-
-    SamCommand_t* samCommand = 0;
-    samCommand = calloc(1, sizeof *samCommand);
-    assert(samCommand);
-
-    samCommand->present = SamCommand_PR_requestPacs;
-    seader->samCommand = samCommand->present;
-
-    samCommand->choice.requestPacs = *requestPacs;
-
-    Payload_t* payload = 0;
-    payload = calloc(1, sizeof *payload);
-    assert(payload);
-
-    payload->present = Payload_PR_samCommand;
-    payload->choice.samCommand = *samCommand;
-
-    seader_send_payload(seader_uart, payload, 0x44, 0x0a, 0x44);
-
-    ASN_STRUCT_FREE(asn_DEF_RequestPacs, requestPacs);
-    ASN_STRUCT_FREE(asn_DEF_SamCommand, samCommand);
-    ASN_STRUCT_FREE(asn_DEF_Payload, payload);
+    seader->samCommand = SamCommand_PR_requestPacs;
+    seader_send_der(
+        seader_uart, seader_der_request_pacs, sizeof(seader_der_request_pacs), 0x44, 0x0a, 0x44);
 }
 
 void seader_worker_send_serial_number(Seader* seader) {
-    SeaderWorker* seader_worker = seader->worker;
-    SeaderUartBridge* seader_uart = seader_worker->uart;
-
-    SamCommand_t* samCommand = 0;
-    samCommand = calloc(1, sizeof *samCommand);
-    assert(samCommand);
-
-    samCommand->present = SamCommand_PR_serialNumber;
-    seader->samCommand = samCommand->present;
-
-    Payload_t* payload = 0;
-    payload = calloc(1, sizeof *payload);
-    assert(payload);
-
-    payload->present = Payload_PR_samCommand;
-    payload->choice.samCommand = *samCommand;
+    // SAM info is only shown for the LPUART SAM
+    SeaderUartBridge* seader_uart = seader->uart;
 
-    seader_send_payload(seader_uart, payload, 0x44, 0x0a, 0x44);
-
-    ASN_STRUCT_FREE(asn_DEF_SamCommand, samCommand);
-    ASN_STRUCT_FREE(asn_DEF_Payload, payload);
+    seader->samCommand = SamCommand_PR_serialNumber;
+    seader_send_der(
+        seader_uart, seader_der_serial_number, sizeof(seader_der_serial_number), 0x44, 0x0a, 0x44);
 }
 
 void seader_worker_send_version(Seader* seader) {
-    SeaderWorker* seader_worker = seader->worker;
-
-    SeaderUartBridge* seader_uart = seader_worker->uart;
-    SamCommand_t* samCommand = 0;
-    samCommand = calloc(1, sizeof *samCommand);
-    assert(samCommand);
-
-    samCommand->present = SamCommand_PR_version;
-    seader->samCommand = samCommand->present;
-
-    Payload_t* payload = 0;
-    payload = calloc(1, sizeof *payload);
-    assert(payload);
+    // SAM info is only shown for the LPUART SAM
+    SeaderUartBridge* seader_uart = seader->uart;
 
-    payload->present = Payload_PR_samCommand;
-    payload->choice.samCommand = *samCommand;
-
-    seader_send_payload(seader_uart, payload, 0x44, 0x0a, 0x44);
-
-    ASN_STRUCT_FREE(asn_DEF_SamCommand, samCommand);
-    ASN_STRUCT_FREE(asn_DEF_Payload, payload);
+    seader->samCommand = SamCommand_PR_version;
+    seader_send_der(
+        seader_uart, seader_der_version, sizeof(seader_der_version), 0x44, 0x0a, 0x44);
 }
 
-void seader_send_card_detected(Seader* seader, CardDetails_t* cardDetails) {
+void seader_send_card_detected(
+    Seader* seader,
+    uint8_t protocol,
+    const uint8_t* csn,
+    uint8_t csn_len,
+    const uint8_t* atqa,
+    const uint8_t* sak) {
     SeaderWorker* seader_worker = seader->worker;
     SeaderUartBridge* seader_uart = seader_worker->uart;
-    CardDetected_t* cardDetected = 0;
-    cardDetected = calloc(1, sizeof *cardDetected);
-    assert(cardDetected);
-
-    cardDetected->detectedCardDetails = *cardDetails;
-
-    SamCommand_t* samCommand = 0;
-    samCommand = calloc(1, sizeof *samCommand);
-    assert(samCommand);
-
-    samCommand->present = SamCommand_PR_cardDetected;
-    seader->samCommand = samCommand->present;
-    samCommand->choice.cardDetected = *cardDetected;
-
-    Payload_t* payload = 0;
-    payload = calloc(1, sizeof *payload);
-    assert(payload);
-
-    payload->present = Payload_PR_samCommand;
-    payload->choice.samCommand = *samCommand;
 
-    seader_send_payload(seader_uart, payload, 0x44, 0x0a, 0x44);
+    uint8_t* frame = seader_ccid_XfrBlockAcquire(&seader_uart->ccid);
+    size_t len = seader_der_encode_card_detected(
+        frame + SEADER_PAYLOAD_OFFSET, protocol, csn, csn_len, atqa, sak);
+    if(len == 0) {
+        FURI_LOG_E(TAG, "CSN too long: %d", csn_len);
+        seader_ccid_XfrBlockSend(&seader_uart->ccid, frame, 0);
+        return;
+    }
 
-    ASN_STRUCT_FREE(asn_DEF_Payload, payload);
-    ASN_STRUCT_FREE(asn_DEF_SamCommand, samCommand);
-    ASN_STRUCT_FREE(asn_DEF_CardDetected, cardDetected);
+    seader->samCommand = SamCommand_PR_cardDetected;
+    seader_send_payload_frame(seader_uart, frame, len, 0x44, 0x0a, 0x44);
 }
 
 bool seader_unpack_pacs(Seader* seader, uint8_t* buf, size_t size) {
     SeaderCredential* seader_credential = seader->credential;
+    char* display = seader_display(seader);
     PAC_t* pac = 0;
     pac = calloc(1, sizeof *pac);
     assert(pac);
@@ -356,21 +374,23 @@ bool seader_unpack_pacs(Seader* seader, uint8_t* buf, size_t size) {
     asn_dec_rval_t rval = asn_decode(0, ATS_DER, &asn_DEF_PAC, (void**)&pac, buf, size);
 
     if(rval.code == RC_OK) {
-        char pacDebug[384] = {0};
-        (&asn_DEF_PAC)
-            ->op->print_struct(&asn_DEF_PAC, pac, 1, seader_print_struct_callback, pacDebug);
-        if(strlen(pacDebug) > 0) {
+        char* pacDebug = seader_debug_log() ? seader_print_struct(&asn_DEF_PAC, pac, 384) : NULL;
+        if(pacDebug && strlen(pacDebug) > 0) {
             FURI_LOG_D(TAG, "Received pac: %s", pacDebug);
 
-            memset(display, 0, sizeof(display));
+            memset(display, 0, SEADER_DISPLAY_LEN);
             if(seader_credential->sio[0] == 0x30) {
                 for(uint8_t i = 0; i < seader_credential->sio_len; i++) {
                     snprintf(
-                        display + (i * 2), sizeof(display), "%02x", seader_credential->sio[i]);
+                        display + (i * 2),
+                        SEADER_DISPLAY_LEN - (i * 2),
+                        "%02x",
+                        seader_credential->sio[i]);
                 }
                 FURI_LOG_D(TAG, "SIO %s", display);
             }
         }
+        free(pacDebug);
 
         if(pac->size <= sizeof(seader_credential->credential)) {
             // TODO: make credential into a 12 byte array
@@ -420,12 +440,12 @@ bool seader_parse_version(SeaderWorker* seader_worker, uint8_t* buf, size_t size
         asn_decode(0, ATS_DER, &asn_DEF_SamVersion, (void**)&version, seq, size + 2);
 
     if(rval.code == RC_OK) {
-        char versionDebug[128] = {0};
-        (&asn_DEF_SamVersion)
-            ->op->print_struct(
-                &asn_DEF_SamVersion, version, 1, seader_print_struct_callback, versionDebug);
-        if(strlen(versionDebug) > 0) {
-            FURI_LOG_D(TAG, "Received version: %s", versionDebug);
+        if(seader_debug_log()) {
+            char* versionDebug = seader_print_struct(&asn_DEF_SamVersion, version, 128);
+            if(strlen(versionDebug) > 0) {
+                FURI_LOG_D(TAG, "Received version: %s", versionDebug);
+            }
+            free(versionDebug);
         }
         if(version->version.size == 2) {
             memcpy(seader_worker->sam_version, version->version.buf, version->version.size);
@@ -475,6 +495,66 @@ bool seader_sam_save_serial(Seader* seader, uint8_t* buf, size_t size) {
     return saved;
 }
 
+/* Single entry, the SAM seen last, keyed by the hash of its ATR */
+bool seader_sam_cache_load(Seader* seader, SeaderSamCache* cache) {
+    SeaderCredential* cred = seader->credential;
+    FlipperFormat* file = flipper_format_file_alloc(cred->storage);
+    FuriString* temp_str = furi_string_alloc();
+    uint32_t file_version = 0;
+    bool loaded = false;
+
+    do {
+        if(!flipper_format_file_open_existing(file, SEADER_SAM_CACHE_PATH)) break;
+        if(!flipper_format_read_header(file, temp_str, &file_version)) break;
+        if(!flipper_format_read_uint32(file, "ATR Hash", &cache->atr_hash, 1)) break;
+        if(!flipper_format_read_hex(file, "Version", cache->version, sizeof(cache->version)))
+            break;
+        if(!flipper_format_read_uint32(file, "Baudrate", &cache->baudrate, 1)) break;
+        loaded = true;
+    } while(false);
+
+    if(!loaded) {
+        memset(cache, 0, sizeof(SeaderSamCache));
+    }
+    furi_string_free(temp_str);
+    flipper_format_free(file);
+    return loaded;
+}
+
+/* Called from the UART worker on a SAM's ATR, so it only looks at what was loaded at startup */
+bool seader_sam_cache_lookup(Seader* seader, uint32_t atr_hash, SeaderSamCache* cache) {
+    bool hit = seader->sam_cache.atr_hash == atr_hash && seader->sam_cache.version[0] != 0;
+    if(hit) {
+        *cache = seader->sam_cache;
+    } else {
+        memset(cache, 0, sizeof(SeaderSamCache));
+        cache->atr_hash = atr_hash;
+    }
+    return hit;
+}
+
+void seader_sam_cache_save(Seader* seader, const SeaderSamCache* cache) {
+    SeaderCredential* cred = seader->credential;
+    FlipperFormat* file = flipper_format_file_alloc(cred->storage);
+    bool saved = false;
+
+    do {
+        if(!flipper_format_file_open_always(file, SEADER_SAM_CACHE_PATH)) break;
+        if(!flipper_format_write_header_cstr(file, "Seader SAM Cache", 1)) break;
+        if(!flipper_format_write_uint32(file, "ATR Hash", &cache->atr_hash, 1)) break;
+        if(!flipper_format_write_hex(file, "Version", cache->version, sizeof(cache->version)))
+            break;
+        if(!flipper_format_write_uint32(file, "Baudrate", &cache->baudrate, 1)) break;
+        saved = true;
+    } while(false);
+
+    if(!saved) {
+        // Only costs a version query next time
+        FURI_LOG_W(TAG, "Can not save SAM cache");
+    }
+    flipper_format_free(file);
+}
+
 bool seader_sam_save_serial_QR(Seader* seader, char* serial) {
     SeaderCredential* cred = seader->credential;
 
@@ -508,9 +588,10 @@ bool seader_sam_save_serial_QR(Seader* seader, char* serial) {
 }
 
 bool seader_parse_serial_number(Seader* seader, uint8_t* buf, size_t size) {
-    memset(display, 0, sizeof(display));
+    char* display = seader_display(seader);
+    memset(display, 0, SEADER_DISPLAY_LEN);
     for(uint8_t i = 0; i < size; i++) {
-        snprintf(display + (i * 2), sizeof(display), "%02x", buf[i]);
+        snprintf(display + (i * 2), SEADER_DISPLAY_LEN - (i * 2), "%02x", buf[i]);
     }
 
     FURI_LOG_D(TAG, "Received serial: %s", display);
@@ -531,7 +612,17 @@ bool seader_parse_sam_response(Seader* seader, SamResponse_t* samResponse) {
         break;
     case SamCommand_PR_version:
         FURI_LOG_I(TAG, "samResponse SamCommand_PR_version");
-        seader_parse_version(seader_worker, samResponse->buf, samResponse->size);
+        if(seader_parse_version(seader_worker, samResponse->buf, samResponse->size)) {
+            SeaderCcidContext* ccid = &seader->uart->ccid;
+            memcpy(ccid->cache.version, seader_worker->sam_version, sizeof(ccid->cache.version));
+            ccid->cache.baudrate = seader->uart->st.baudrate;
+            // Saved on exit, the UART worker does not wait on storage
+            seader->sam_cache = ccid->cache;
+            seader->sam_cache_dirty = true;
+        } else {
+            seader_worker_version_failed(seader);
+            break;
+        }
         seader_worker_send_serial_number(seader);
         break;
     case SamCommand_PR_serialNumber:
@@ -543,16 +634,18 @@ bool seader_parse_sam_response(Seader* seader, SamResponse_t* samResponse) {
         FURI_LOG_I(TAG, "samResponse SamCommand_PR_cardDetected");
         seader_send_request_pacs(seader);
         break;
-    case SamCommand_PR_NOTHING:
+    case SamCommand_PR_NOTHING: {
         FURI_LOG_I(TAG, "samResponse SamCommand_PR_NOTHING");
-        memset(display, 0, sizeof(display));
+        char* display = seader_display(seader);
+        memset(display, 0, SEADER_DISPLAY_LEN);
         for(uint8_t i = 0; i < samResponse->size; i++) {
-            snprintf(display + (i * 2), sizeof(display), "%02x", samResponse->buf[i]);
+            snprintf(display + (i * 2), SEADER_DISPLAY_LEN - (i * 2), "%02x", samResponse->buf[i]);
         }
         FURI_LOG_I(TAG, "Unknown samResponse %d: %s", samResponse->size, display);
         view_dispatcher_send_custom_event(seader->view_dispatcher, SeaderCustomEventWorkerExit);
         break;
     }
+    }
 
     return false;
 }
@@ -570,36 +663,26 @@ bool seader_parse_response(Seader* seader, Response_t* response) {
 }
 
 void seader_send_nfc_rx(SeaderUartBridge* seader_uart, uint8_t* buffer, size_t len) {
+    uint32_t allocs = seader_calloc_count;
     OCTET_STRING_t rxData = {.buf = buffer, .size = len};
     uint8_t status[] = {0x00, 0x00};
-    RfStatus_t rfStatus = {.buf = status, .size = 2};
-
-    NFCRx_t* nfcRx = 0;
-    nfcRx = calloc(1, sizeof *nfcRx);
-    assert(nfcRx);
 
-    nfcRx->rfStatus = rfStatus;
-    nfcRx->data = &rxData;
-
-    NFCResponse_t* nfcResponse = 0;
-    nfcResponse = calloc(1, sizeof *nfcResponse);
-    assert(nfcResponse);
-
-    nfcResponse->present = NFCResponse_PR_nfcRx;
-    nfcResponse->choice.nfcRx = *nfcRx;
-
-    Response_t* response = 0;
-    response = calloc(1, sizeof *response);
-    assert(response);
-
-    response->present = Response_PR_nfcResponse;
-    response->choice.nfcResponse = *nfcResponse;
-
-    seader_send_response(seader_uart, response, 0x14, 0x0a, 0x0);
+    // Only points at buffer and status, so there is nothing to free
+    Response_t response = {
+        .present = Response_PR_nfcResponse,
+        .choice.nfcResponse = {
+            .present = NFCResponse_PR_nfcRx,
+            .choice.nfcRx = {
+                .data = &rxData,
+                .rfStatus = {.buf = status, .size = sizeof(status)},
+            },
+        },
+    };
+    seader_send_response(seader_uart, &response, 0x14, 0x0a, 0x0);
 
-    ASN_STRUCT_FREE(asn_DEF_NFCRx, nfcRx);
-    ASN_STRUCT_FREE(asn_DEF_NFCResponse, nfcResponse);
-    ASN_STRUCT_FREE(asn_DEF_Response, response);
+    // Other threads can allocate meanwhile, so this can overcount but a 0 holds
+    seader_uart->st.nfc_rx_cnt++;
+    seader_uart->st.nfc_rx_allocs += seader_calloc_count - allocs;
 }
 
 void seader_capture_sio(BitBuffer* tx_buffer, BitBuffer* rx_buffer, SeaderCredential* credential) {
@@ -664,7 +747,7 @@ void seader_iso15693_transmit(
         }
 
         if(error != PicopassErrorNone) {
-            seader_worker->stage = SeaderPollerEventTypeFail;
+            seader_worker_abort(seader);
             break;
         }
 
@@ -713,7 +796,7 @@ void seader_iso14443a_transmit(
                 iso14443_4a_poller_send_block(iso14443_4a_poller, tx_buffer, rx_buffer);
             if(error != Iso14443_4aErrorNone) {
                 FURI_LOG_W(TAG, "iso14443_4a_poller_send_block error %d", error);
-                seader_worker->stage = SeaderPollerEventTypeFail;
+                seader_worker_abort(seader);
                 break;
             }
         }
@@ -745,6 +828,7 @@ void seader_mfc_transmit(
     furi_assert(mfc_poller);
     SeaderWorker* seader_worker = seader->worker;
     SeaderUartBridge* seader_uart = seader_worker->uart;
+    char* display = seader_worker->display;
 
     BitBuffer* tx_buffer = bit_buffer_alloc(len);
     BitBuffer* rx_buffer = bit_buffer_alloc(SEADER_POLLER_MAX_BUFFER_SIZE);
@@ -756,16 +840,16 @@ void seader_mfc_transmit(
                 mf_classic_poller_send_frame(mfc_poller, tx_buffer, rx_buffer, MF_CLASSIC_FWT_FC);
             if(error != MfClassicErrorNone) {
                 FURI_LOG_W(TAG, "mf_classic_poller_send_frame error %d", error);
-                seader_worker->stage = SeaderPollerEventTypeFail;
+                seader_worker_abort(seader);
                 break;
             }
         } else if(
             (format[0] == 0x00 && format[1] == 0x00 && format[2] == 0x40) ||
             (format[0] == 0x00 && format[1] == 0x00 && format[2] == 0x24) ||
             (format[0] == 0x00 && format[1] == 0x00 && format[2] == 0x44)) {
-            memset(display, 0, sizeof(display));
+            memset(display, 0, SEADER_DISPLAY_LEN);
             for(uint8_t i = 0; i < len; i++) {
-                snprintf(display + (i * 2), sizeof(display), "%02x", buffer[i]);
+                snprintf(display + (i * 2), SEADER_DISPLAY_LEN - (i * 2), "%02x", buffer[i]);
             }
             FURI_LOG_D(TAG, "NFC Send with parity %d: %s", len, display);
 
@@ -795,10 +879,13 @@ void seader_mfc_transmit(
                     tx_buffer, i, buffer[i], bit_lib_get_bit(&tx_parity, i));
             }
 
-            memset(display, 0, sizeof(display));
+            memset(display, 0, SEADER_DISPLAY_LEN);
             for(uint8_t i = 0; i < bit_buffer_get_size_bytes(tx_buffer); i++) {
                 snprintf(
-                    display + (i * 2), sizeof(display), "%02x", bit_buffer_get_byte(tx_buffer, i));
+                    display + (i * 2),
+                    SEADER_DISPLAY_LEN - (i * 2),
+                    "%02x",
+                    bit_buffer_get_byte(tx_buffer, i));
             }
             FURI_LOG_D(
                 TAG,
@@ -811,17 +898,20 @@ void seader_mfc_transmit(
                 mfc_poller, tx_buffer, rx_buffer, MF_CLASSIC_FWT_FC);
             if(error != MfClassicErrorNone) {
                 FURI_LOG_W(TAG, "mf_classic_poller_send_encrypted_frame error %d", error);
-                seader_worker->stage = SeaderPollerEventTypeFail;
+                seader_worker_abort(seader);
                 break;
             }
 
             size_t length = bit_buffer_get_size_bytes(rx_buffer);
             const uint8_t* rx_parity = bit_buffer_get_parity(rx_buffer);
 
-            memset(display, 0, sizeof(display));
+            memset(display, 0, SEADER_DISPLAY_LEN);
             for(uint8_t i = 0; i < length; i++) {
                 snprintf(
-                    display + (i * 2), sizeof(display), "%02x", bit_buffer_get_byte(rx_buffer, i));
+                    display + (i * 2),
+                    SEADER_DISPLAY_LEN - (i * 2),
+                    "%02x",
+                    bit_buffer_get_byte(rx_buffer, i));
             }
             FURI_LOG_D(
                 TAG, "NFC Response without parity %d: %s [%02x]", length, display, rx_parity[0]);
@@ -862,10 +952,13 @@ void seader_mfc_transmit(
 
             bit_buffer_copy_bytes(rx_buffer, with_parity, length);
 
-            memset(display, 0, sizeof(display));
+            memset(display, 0, SEADER_DISPLAY_LEN);
             for(uint8_t i = 0; i < length; i++) {
                 snprintf(
-                    display + (i * 2), sizeof(display), "%02x", bit_buffer_get_byte(rx_buffer, i));
+                    display + (i * 2),
+                    SEADER_DISPLAY_LEN - (i * 2),
+                    "%02x",
+                    bit_buffer_get_byte(rx_buffer, i));
             }
             FURI_LOG_D(
                 TAG, "NFC Response with parity %d: %s [%02x]", length, display, rx_parity[0]);
@@ -892,20 +985,22 @@ void seader_parse_nfc_command_transmit(
     Protocol_t protocol = nfcSend->protocol;
     FrameProtocol_t frameProtocol = protocol.buf[1];
 
-#ifdef ASN1_DEBUG
-    memset(display, 0, sizeof(display));
-    for(uint8_t i = 0; i < nfcSend->data.size; i++) {
-        snprintf(display + (i * 2), sizeof(display), "%02x", nfcSend->data.buf[i]);
-    }
+    if(seader_debug_log()) {
+        char* display = seader->worker->display;
+        memset(display, 0, SEADER_DISPLAY_LEN);
+        for(uint8_t i = 0; i < nfcSend->data.size; i++) {
+            snprintf(
+                display + (i * 2), SEADER_DISPLAY_LEN - (i * 2), "%02x", nfcSend->data.buf[i]);
+        }
 
-    FURI_LOG_D(
-        TAG,
-        "Transmit (%ld timeout) %d bytes [%s] via %lx",
-        timeOut,
-        nfcSend->data.size,
-        display,
-        frameProtocol);
-#endif
+        FURI_LOG_D(
+            TAG,
+            "Transmit (%ld timeout) %d bytes [%s] via %lx",
+            timeOut,
+            nfcSend->data.size,
+            display,
+            frameProtocol);
+    }
 
     if(seader->credential->type == SeaderCredentialTypeVirtual) {
         seader_picopass_state_machine(seader, nfcSend->data.buf, nfcSend->data.size);
@@ -938,23 +1033,7 @@ void seader_parse_nfc_command_transmit(
 void seader_parse_nfc_off(SeaderUartBridge* seader_uart) {
     FURI_LOG_D(TAG, "Set Field Off");
 
-    NFCResponse_t* nfcResponse = 0;
-    nfcResponse = calloc(1, sizeof *nfcResponse);
-    assert(nfcResponse);
-
-    nfcResponse->present = NFCResponse_PR_nfcAck;
-
-    Response_t* response = 0;
-    response = calloc(1, sizeof *response);
-    assert(response);
-
-    response->present = Response_PR_nfcResponse;
-    response->choice.nfcResponse = *nfcResponse;
-
-    seader_send_response(seader_uart, response, 0x44, 0x0a, 0);
-
-    ASN_STRUCT_FREE(asn_DEF_Response, response);
-    ASN_STRUCT_FREE(asn_DEF_NFCResponse, nfcResponse);
+    seader_send_der(seader_uart, seader_der_nfc_ack, sizeof(seader_der_nfc_ack), 0x44, 0x0a, 0);
 }
 
 void seader_parse_nfc_command(Seader* seader, NFCCommand_t* nfcCommand, SeaderPollerContainer* spc) {
@@ -1011,6 +1090,7 @@ bool seader_process_success_response_i(
     size_t len,
     bool online,
     SeaderPollerContainer* spc) {
+    char* display = seader_display(seader);
     Payload_t* payload = 0;
     payload = calloc(1, sizeof *payload);
     assert(payload);
@@ -1019,30 +1099,25 @@ bool seader_process_success_response_i(
     asn_dec_rval_t rval =
         asn_decode(0, ATS_DER, &asn_DEF_Payload, (void**)&payload, apdu + 6, len - 6);
     if(rval.code == RC_OK) {
-#ifdef ASN1_DEBUG
-        if(online == false) {
-            memset(display, 0, sizeof(display));
-            for(uint8_t i = 0; i < len - 6; i++) {
-                snprintf(display + (i * 2), sizeof(display), "%02x", apdu[i + 6]);
+        if(online == false && seader_debug_log()) {
+            memset(display, 0, SEADER_DISPLAY_LEN);
+            for(size_t i = 0; i < len - 6; i++) {
+                snprintf(display + (i * 2), SEADER_DISPLAY_LEN - (i * 2), "%02x", apdu[i + 6]);
             }
             FURI_LOG_D(TAG, "incoming APDU %s", display);
 
-            char payloadDebug[384] = {0};
-            memset(payloadDebug, 0, sizeof(payloadDebug));
-            (&asn_DEF_Payload)
-                ->op->print_struct(
-                    &asn_DEF_Payload, payload, 1, seader_print_struct_callback, payloadDebug);
+            char* payloadDebug = seader_print_struct(&asn_DEF_Payload, payload, 384);
             if(strlen(payloadDebug) > 0) {
                 FURI_LOG_D(TAG, "Payload: %s", payloadDebug);
             }
+            free(payloadDebug);
         }
-#endif
 
         processed = seader_worker_state_machine(seader, payload, online, spc);
     } else {
-        memset(display, 0, sizeof(display));
-        for(uint8_t i = 0; i < len; i++) {
-            snprintf(display + (i * 2), sizeof(display), "%02x", apdu[i]);
+        memset(display, 0, SEADER_DISPLAY_LEN);
+        for(size_t i = 0; i < len; i++) {
+            snprintf(display + (i * 2), SEADER_DISPLAY_LEN - (i * 2), "%02x", apdu[i]);
         }
         FURI_LOG_D(TAG, "Failed to decode APDU payload: [%s]", display);
     }
@@ -1066,44 +1141,26 @@ NfcCommand seader_worker_card_detect(
     UNUSED(ats);
     UNUSED(ats_len);
 
-    SeaderCredential* credential = seader->credential;
-
-    CardDetails_t* cardDetails = 0;
-    cardDetails = calloc(1, sizeof *cardDetails);
-    assert(cardDetails);
+    // Each card is a new conversation, hand it to the least busy SAM
+    seader->worker->uart = seader_uart_select_idle(seader);
 
-    OCTET_STRING_fromBuf(&cardDetails->csn, (const char*)uid, uid_len);
-    OCTET_STRING_t sak_string = {.buf = &sak, .size = 1};
-    OCTET_STRING_t atqa_string = {.buf = atqa, .size = 2};
-    uint8_t protocol_bytes[] = {0x00, 0x00};
+    SeaderCredential* credential = seader->credential;
 
     if(sak == 0 && atqa == NULL) { // picopass
-        protocol_bytes[1] = FrameProtocol_iclass;
-        OCTET_STRING_fromBuf(
-            &cardDetails->protocol, (const char*)protocol_bytes, sizeof(protocol_bytes));
         memcpy(credential->diversifier, uid, uid_len);
         credential->diversifier_len = uid_len;
         credential->isDesfire = false;
+        seader_send_card_detected(seader, FrameProtocol_iclass, uid, uid_len, NULL, NULL);
     } else if(atqa == 0) { // MFC
-        protocol_bytes[1] = FrameProtocol_nfc;
-        OCTET_STRING_fromBuf(
-            &cardDetails->protocol, (const char*)protocol_bytes, sizeof(protocol_bytes));
-        cardDetails->sak = &sak_string;
+        seader_send_card_detected(seader, FrameProtocol_nfc, uid, uid_len, NULL, &sak);
     } else { // type 4
-        protocol_bytes[1] = FrameProtocol_nfc;
-        OCTET_STRING_fromBuf(
-            &cardDetails->protocol, (const char*)protocol_bytes, sizeof(protocol_bytes));
-        cardDetails->sak = &sak_string;
-        cardDetails->atqa = &atqa_string;
         credential->isDesfire = seader_mf_df_check_card_type(atqa[0], atqa[1], sak);
         if(credential->isDesfire) {
             memcpy(credential->diversifier, uid, uid_len);
             credential->diversifier_len = uid_len;
         }
+        seader_send_card_detected(seader, FrameProtocol_nfc, uid, uid_len, atqa, &sak);
     }
 
-    seader_send_card_detected(seader, cardDetails);
-
-    ASN_STRUCT_FREE(asn_DEF_CardDetails, cardDetails);
     return NfcCommandContinue;
 }
@@ -21,6 +21,18 @@ NfcCommand seader_worker_card_detect(
     uint8_t* ats,
     uint8_t ats_len);
 
+void seader_send_card_detected(
+    Seader* seader,
+    uint8_t protocol,
+    const uint8_t* csn,
+    uint8_t csn_len,
+    const uint8_t* atqa,
+    const uint8_t* sak);
+
+bool seader_sam_cache_load(Seader* seader, SeaderSamCache* cache);
+bool seader_sam_cache_lookup(Seader* seader, uint32_t atr_hash, SeaderSamCache* cache);
+void seader_sam_cache_save(Seader* seader, const SeaderSamCache* cache);
+
 bool seader_process_success_response_i(
     Seader* seader,
     uint8_t* apdu,
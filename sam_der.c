@@ -0,0 +1,62 @@
+#include "sam_der.h"
+
+#include <string.h>
+
+// No furi here, the host test in test/der_templates.c builds this file as well
+
+// samCommand [0] { version [2] NULL }
+const uint8_t seader_der_version[4] = {0xa0, 0x02, 0x82, 0x00};
+// samCommand [0] { serialNumber [22] NULL }
+const uint8_t seader_der_serial_number[4] = {0xa0, 0x02, 0x96, 0x00};
+// samCommand [0] { requestPacs [1] { contentElementTag [0] implicitFormatPhysicalAccessBits } }
+const uint8_t seader_der_request_pacs[7] = {0xa0, 0x05, 0xa1, 0x03, 0x80, 0x01, 0x04};
+// response [29] { nfcResponse [0] { nfcAck [2] NULL } }
+const uint8_t seader_der_nfc_ack[6] = {0xbd, 0x04, 0xa0, 0x02, 0x82, 0x00};
+// samCommand [0] { cardDetected [13] { detectedCardDetails [0] { .. } } }, the three lengths
+// are patched once the CardDetails fields are appended
+static const uint8_t seader_der_card_detected[] = {0xa0, 0x00, 0xad, 0x00, 0xa0, 0x00};
+
+/* Appends an IMPLICIT [tag] OCTET STRING of CardDetails */
+static size_t
+    seader_der_append(uint8_t* der, size_t pos, uint8_t tag, const uint8_t* buf, size_t len) {
+    der[pos++] = 0x80 | tag;
+    der[pos++] = len;
+    memcpy(der + pos, buf, len);
+    return pos + len;
+}
+
+/*
+ * seader_der_card_detected with the CardDetails fields in place, atqa and sak are left out
+ * when NULL. Returns the encoded length, 0 when it does not fit the short form lengths.
+ */
+size_t seader_der_encode_card_detected(
+    uint8_t* der,
+    uint8_t protocol,
+    const uint8_t* csn,
+    uint8_t csn_len,
+    const uint8_t* atqa,
+    const uint8_t* sak) {
+    const size_t header = sizeof(seader_der_card_detected);
+    // protocol, csn, atqa and sak with their tag and length bytes
+    size_t fields = (2 + 2) + (2 + csn_len) + (atqa ? 2 + 2 : 0) + (sak ? 2 + 1 : 0);
+    if(header + fields > SEADER_DER_CARD_DETECTED_MAX) {
+        return 0;
+    }
+
+    const uint8_t protocol_bytes[] = {0x00, protocol};
+    memcpy(der, seader_der_card_detected, header);
+    size_t pos = header;
+    pos = seader_der_append(der, pos, 0, protocol_bytes, sizeof(protocol_bytes));
+    pos = seader_der_append(der, pos, 1, csn, csn_len);
+    if(atqa) {
+        pos = seader_der_append(der, pos, 2, atqa, 2);
+    }
+    if(sak) {
+        pos = seader_der_append(der, pos, 3, sak, 1);
+    }
+
+    der[1] = fields + 4;
+    der[3] = fields + 2;
+    der[5] = fields;
+    return pos;
+}
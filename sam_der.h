@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Payloads that never change, DER encoded from seader.asn1 ahead of time. Tags are explicit
+// unless the module marks them IMPLICIT. test/der_templates.c compares them with the encoder.
+extern const uint8_t seader_der_version[4];
+extern const uint8_t seader_der_serial_number[4];
+extern const uint8_t seader_der_request_pacs[7];
+extern const uint8_t seader_der_nfc_ack[6];
+
+// Short form lengths only, the whole message has to stay under 128 bytes
+#define SEADER_DER_CARD_DETECTED_MAX (0x7f + 2)
+
+size_t seader_der_encode_card_detected(
+    uint8_t* der,
+    uint8_t protocol,
+    const uint8_t* csn,
+    uint8_t csn_len,
+    const uint8_t* atqa,
+    const uint8_t* sak);
@@ -27,7 +27,8 @@ void seader_scene_start_on_enter(void* context) {
     popup_set_context(seader->popup, seader);
     popup_set_callback(seader->popup, seader_scene_start_detect_callback);
     popup_set_header(popup, "Detecting SAM", 58, 48, AlignCenter, AlignCenter);
-    popup_set_timeout(seader->popup, 2500);
+    // The probe reports a missing SAM itself, this only covers a worker that never answers
+    popup_set_timeout(seader->popup, SEADER_CCID_PROBE_TIMEOUT_MS + SEADER_UART_FRAME_TIMEOUT_MS);
     popup_enable_timeout(seader->popup);
 
     // Start worker
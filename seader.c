@@ -42,9 +42,22 @@ Seader* seader_alloc() {
     view_dispatcher_set_tick_event_callback(
         seader->view_dispatcher, seader_tick_event_callback, 100);
 
-    seader->uart = seader_uart_alloc(seader);
-
     seader->credential = seader_credential_alloc();
+    seader->sam_cache_dirty = false;
+    seader_sam_cache_load(seader, &seader->sam_cache);
+
+#ifdef SEADER_TRANSPORT_REPLAY
+    // No reader needed, answers come from SEADER_REPLAY_PATH
+    seader->uart = seader_uart_alloc(seader, FuriHalSerialIdLpuart, &seader_replay_transport);
+#else
+    seader->uart = seader_uart_alloc(seader, FuriHalSerialIdLpuart, &seader_uart_transport);
+#endif
+#ifdef SEADER_UART_DUAL
+    // Takes the USART from the CLI, so it is opt in
+    seader->uart2 = seader_uart_alloc(seader, FuriHalSerialIdUsart, &seader_uart_transport);
+#else
+    seader->uart2 = NULL;
+#endif
 
     seader->nfc = nfc_alloc();
 
@@ -124,6 +137,13 @@ void seader_free(Seader* seader) {
 
     seader_uart_free(seader->uart);
     seader->uart = NULL;
+    if(seader->uart2) {
+        seader_uart_free(seader->uart2);
+        seader->uart2 = NULL;
+    }
+    if(seader->sam_cache_dirty) {
+        seader_sam_cache_save(seader, &seader->sam_cache);
+    }
 
     seader_credential_free(seader->credential);
     seader->credential = NULL;
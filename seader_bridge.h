@@ -9,38 +9,372 @@
 #include <furi.h>
 #include <furi_hal.h>
 
-#define SEADER_UART_RX_BUF_SIZE (128)
+// Largest APDU carried in one CCID frame, defaults to a short APDU with Lc = 255 and Le.
+// Can be raised at build time for longer responses, commands are always sent as short APDUs.
+#ifndef SEADER_APDU_MAX_LEN
+#define SEADER_APDU_MAX_LEN (5 + 255 + 1)
+#endif
+// SYNC, CTRL and the CCID header in front of the payload, LRC after it
+#define SEADER_CCID_HEADER_LEN (2 + 10)
+#define SEADER_CCID_FRAME_OVERHEAD (SEADER_CCID_HEADER_LEN + 1)
+#define SEADER_UART_RX_BUF_SIZE (SEADER_CCID_FRAME_OVERHEAD + SEADER_APDU_MAX_LEN)
+// Hex dump of a whole frame and its terminator
+#define SEADER_DISPLAY_LEN (SEADER_UART_RX_BUF_SIZE * 2 + 1)
+// Must be a power of two so the free running indexes can be masked, and hold more than
+// one full frame so the next one can stream in while the last is parsed
+#define SEADER_UART_RX_RING_SIZE (1024)
+#define SEADER_UART_RX_RING_MASK (SEADER_UART_RX_RING_SIZE - 1)
+#if SEADER_UART_RX_RING_SIZE < 2 * SEADER_UART_RX_BUF_SIZE
+#error "SEADER_UART_RX_RING_SIZE must hold two frames of SEADER_APDU_MAX_LEN"
+#endif
+// How long a partially received frame may sit in the ring before it is dropped
+#define SEADER_UART_FRAME_TIMEOUT_MS (50)
+
+// RTS/CTS pair of the LPUART bridge and of the USART one, a 1 based index into flow_pins in
+// uart.c. 0 leaves flow control off, which is the default as the pins are free GPIO otherwise.
+#ifndef SEADER_UART_FLOW_PINS
+#define SEADER_UART_FLOW_PINS (0)
+#endif
+#ifndef SEADER_UART2_FLOW_PINS
+#define SEADER_UART2_FLOW_PINS (0)
+#endif
+#if SEADER_UART_FLOW_PINS != 0 && SEADER_UART_FLOW_PINS == SEADER_UART2_FLOW_PINS
+#error "SEADER_UART_FLOW_PINS and SEADER_UART2_FLOW_PINS cannot share a pair"
+#endif
+
+// rx_ring free space below which RTS is released, and above which it is asserted again
+#define SEADER_UART_RTS_OFF_SPACE (128)
+#define SEADER_UART_RTS_ON_SPACE (SEADER_UART_RX_RING_SIZE / 2)
+
+// CCID slots on the reader, each one can have a single command outstanding
+#define SEADER_CCID_SLOTS (2)
+// Retransmits of an unanswered command, after a NAK, a line error or its deadline, before it
+// is dropped
+#define SEADER_CCID_RETRANSMIT_MAX (2)
+// Answer deadlines, an XfrBlock waits on the SAM and a power on on the ATR
+#define SEADER_CCID_CMD_TIMEOUT_MS (100)
+#define SEADER_CCID_POWER_ON_TIMEOUT_MS (500)
+#define SEADER_CCID_XFR_TIMEOUT_MS (1500)
+// Longest seader_ccid_check_for_sam can take to reach a verdict, a GetSlotStatus and then an
+// IccPowerOn that both use up their retransmits
+#define SEADER_CCID_PROBE_TIMEOUT_MS                                  \
+    ((SEADER_CCID_CMD_TIMEOUT_MS + SEADER_CCID_POWER_ON_TIMEOUT_MS) * \
+     (SEADER_CCID_RETRANSMIT_MAX + 1))
+
+// Idle time after which the SAM is powered off until the next APDU, 0 keeps it powered.
+// Default for SeaderUartConfig.sam_idle_off_ms.
+#ifndef SEADER_SAM_IDLE_OFF_MS
+#define SEADER_SAM_IDLE_OFF_MS (30000)
+#endif
+// A wake from power on to the first APDU going out that takes longer is logged
+#define SEADER_SAM_WAKE_BUDGET_MS (150)
+// Busy time an error adds to a SAM's cost when the next conversation is handed out
+#define SEADER_SAM_ERROR_COST_MS (500)
+
+// Frames that can be built or queued before a builder has to wait for the TX thread
+#define SEADER_UART_TX_QUEUE_LEN (4)
+// Plus one per slot, the last command of each is held until its answer for a retransmit
+#define SEADER_UART_TX_POOL_LEN (SEADER_UART_TX_QUEUE_LEN + SEADER_CCID_SLOTS)
+
+#define SEADER_UART_BAUDRATE_DEFAULT (115200)
+// How long to wait for the reader to answer while moving to a new baudrate
+#define SEADER_UART_BAUDRATE_TIMEOUT_MS (250)
+// Build with SEADER_UART_BAUDRATE_NEGOTIATE for SeaderUartBaudrateModeNegotiate, fixed otherwise
+#ifdef SEADER_UART_BAUDRATE_NEGOTIATE
+#define SEADER_UART_BAUDRATE_MODE SeaderUartBaudrateModeNegotiate
+#else
+#define SEADER_UART_BAUDRATE_MODE SeaderUartBaudrateModeFixed
+#endif
+
+typedef enum {
+    // RX worker plus a TX thread that only hands descriptors to the DMA
+    SeaderUartThreadModeSplit,
+    // The RX worker also kicks the TX DMA, no second thread or stack
+    SeaderUartThreadModeSingle,
+} SeaderUartThreadMode;
+
+typedef enum {
+    SeaderUartBaudrateModeFixed,
+    // Only for reader firmware that moves its host UART to the dwDataRate it is given. CCID
+    // itself means the reader to card rate there, a stock reader keeps the host link as it is.
+    SeaderUartBaudrateModeNegotiate,
+} SeaderUartBaudrateMode;
+
+typedef enum {
+    SeaderUartBaudrateStateIdle,
+    SeaderUartBaudrateStateParameters,
+    SeaderUartBaudrateStateDataRate,
+    SeaderUartBaudrateStateVerify,
+    // The new rate did not work, the reader is told to go back before we follow it
+    SeaderUartBaudrateStateRevert,
+    SeaderUartBaudrateStateRevertVerify,
+} SeaderUartBaudrateState;
 
 typedef struct {
     uint8_t uart_ch;
     uint8_t flow_pins;
     uint8_t baudrate_mode;
     uint32_t baudrate;
+    uint8_t thread_mode;
+    // SEADER_SAM_IDLE_OFF_MS unless set otherwise, 0 never powers the SAM off
+    uint32_t sam_idle_off_ms;
 } SeaderUartConfig;
 
+/*
+ * Single producer/single consumer ring: head is only advanced by the DMA callback,
+ * tail is only advanced by the UART worker once the CCID parser has consumed a frame.
+ */
+typedef struct {
+    uint8_t buf[SEADER_UART_RX_RING_SIZE];
+    volatile size_t head;
+    volatile size_t tail;
+} SeaderUartRing;
+
+typedef struct {
+    uint8_t buf[SEADER_UART_RX_BUF_SIZE];
+    size_t len;
+    // From acquire until the CCID layer releases it, a sent frame stays for its retransmits
+    volatile bool held;
+    // In tx_fifo or being clocked out, cleared by the TX DMA interrupt
+    volatile bool queued;
+    // Tick of the submit, then of the TX DMA interrupt once this frame has gone out
+    volatile uint32_t done_tick;
+} SeaderUartTxDesc;
+
 typedef struct {
     uint32_t rx_cnt;
     uint32_t tx_cnt;
     uint8_t protocol;
+    uint32_t baudrate;
+    // Time from the command frame leaving the wire to the SAM's DataBlock being parsed, in ms
+    uint32_t apdu_cnt;
+    uint32_t apdu_latency_last;
+    uint32_t apdu_latency_max;
+    uint32_t apdu_latency_total;
+    // Returns from furi_thread_flags_wait, each one is a context switch into the thread
+    uint32_t rx_wakeups;
+    uint32_t tx_wakeups;
+    // Stack high-water marks, bytes never touched, sampled when the bridge stops
+    uint32_t rx_stack_free;
+    uint32_t tx_stack_free;
+    // RTS released because rx_ring was nearly full, TX frames held back by CTS
+    uint32_t rts_throttled;
+    uint32_t cts_stalled;
+    // Line errors reported by the UART, and the flush and retransmit they caused
+    uint32_t frame_errors;
+    uint32_t noise_errors;
+    uint32_t overrun_errors;
+    uint32_t resyncs;
+    uint32_t resends;
+    // Bytes between frames that were neither a frame start nor a notification
+    uint32_t skipped_bytes;
+    // Frames whose LRC did not check out, each one resends the command like a line error
+    uint32_t lrc_errors;
+    // CCID commands sent again after a NAK or a missed deadline, answers whose slot and bSeq
+    // matched nothing outstanding, and commands given up after SEADER_CCID_RETRANSMIT_MAX
+    uint32_t nak_resends;
+    uint32_t timeout_resends;
+    uint32_t stale_answers;
+    uint32_t requests_lost;
+    // Answers that only asked for more time, or reported a transfer error or a busy slot that
+    // the command was retried after
+    uint32_t time_extensions;
+    uint32_t recovered_errors;
+    // SAM power offs after SEADER_SAM_IDLE_OFF_MS, and the warm restarts that followed them
+    uint32_t sam_power_offs;
+    uint32_t sam_wakes;
+    uint32_t wake_latency_last;
+    uint32_t wake_latency_max;
+    uint32_t wakes_over_budget;
+    // NFCRx responses sent, and the calloc calls made while building them, expected to stay 0
+    uint32_t nfc_rx_cnt;
+    uint32_t nfc_rx_allocs;
 } SeaderUartState;
 
+typedef struct SeaderTransport SeaderTransport;
+typedef struct SeaderUartBridge SeaderUartBridge;
+
+// ISO 7816-3 8.2: TS, T0, up to 4 groups of interface bytes, 15 historical bytes and TCK
+#define SEADER_ATR_MAX_LEN (33)
+
+/* Answer to reset decoded by seader_ccid_atr_parse, defaults filled in for absent bytes */
+typedef struct {
+    uint8_t ts;
+    uint8_t t0;
+    // Fi/Di, 0x11 when TA1 is absent
+    uint8_t ta1;
+    // Extra guard time
+    uint8_t tc1;
+    // TA2 present, the card stays in the mode it announces and ta1 applies as is
+    bool specific_mode;
+    uint8_t ta2;
+    // Bit n set when T=n is offered in a TD byte, T=0 alone when there is none
+    uint16_t protocols;
+    // From the first TA and TB for T=1, 32 and BWI 4 CWI 13 when absent
+    uint8_t ifsc;
+    uint8_t bwi_cwi;
+    uint8_t historical[15];
+    uint8_t historical_len;
+    // TCK is only present, and checked, when something other than T=0 is offered
+    bool tck_ok;
+    // FNV-1a over the raw bytes, keys the SAM cache
+    uint32_t hash;
+} SeaderAtr;
+
+/* What a SAM with a given ATR answered on an earlier launch */
+typedef struct {
+    uint32_t atr_hash;
+    uint8_t version[2];
+    // Baudrate the bridge ended up at, the default when negotiation failed
+    uint32_t baudrate;
+} SeaderSamCache;
+
+typedef enum {
+    // Looking for SYNC or a NotifySlotChange
+    SeaderCcidParseStart,
+    // SYNC CTRL seen, waiting for the header
+    SeaderCcidParseHeader,
+    // frame_len known, waiting for the rest of the frame
+    SeaderCcidParseBody,
+} SeaderCcidParseState;
+
+typedef enum {
+    SeaderSamPowerOn,
+    // Powered off while idle, ATR and cache are kept for the warm restart
+    SeaderSamPowerOff,
+    // IccPowerOn sent for an APDU waiting in tx_chain, the ATR is next
+    SeaderSamPowerWaking,
+    // ATR matched, SetParameters is putting back what the SAM ran with before
+    SeaderSamPowerRestoring,
+} SeaderSamPower;
+
+/* A SAM found in one of the reader's slots, conversations are spread over all of them */
+typedef struct {
+    bool present;
+    SeaderSamPower power;
+    // Tick the APDU in flight was sent at, busy_ms adds up the time until each answer
+    uint32_t busy_since;
+    uint32_t busy_ms;
+    uint32_t apdus;
+    // Commands that failed or went unanswered, weighed against apdus by the dispatcher
+    uint32_t errors;
+} SeaderSam;
+
+/* A command waiting for its RDR_to_PC answer */
+typedef struct {
+    bool active;
+    uint8_t type;
+    uint8_t seq;
+    uint8_t retries;
+    uint32_t deadline;
+    // Transport buffer it went out in, held until the answer or the drop and sent again as is
+    uint8_t* frame;
+} SeaderCcidRequest;
+
+/* State of one CCID reader, passed to the frame builders and the parser in ccid.c */
+typedef struct {
+    // Bridge the frames go out on
+    SeaderUartBridge* uart;
+    // Guards pending and last_slot, commands are sent from the UART, NFC and Seader workers
+    FuriMutex* lock;
+    // Indexed by bSlot, answers are matched on bSeq
+    SeaderCcidRequest pending[SEADER_CCID_SLOTS];
+    // Slot of the last command sent, the one a NAK or a line error refers to
+    uint8_t last_slot;
+    // Fires WorkerEvtCcidTimeout at the earliest pending deadline
+    FuriTimer* timer;
+    // Parser position, only valid while rx_ring.tail is still parse_tail
+    SeaderCcidParseState parse_state;
+    size_t parse_tail;
+    size_t frame_len;
+    // Any slot holds a SAM, sam_slot is the one the current conversation was given
+    bool has_sam;
+    bool powered[SEADER_CCID_SLOTS];
+    uint8_t sam_slot;
+    // Only the worker moves sam_slot, seader_ccid_select_slot hands it the slot and waits
+    uint8_t select_slot;
+    FuriSemaphore* selected;
+    SeaderSam sams[SEADER_CCID_SLOTS];
+    uint8_t sequence[SEADER_CCID_SLOTS];
+    // Slots seader_ccid_check_for_sam has not reached a verdict on, one bit each
+    uint8_t probing;
+    // A probed slot answered with an ATR that is not a SAM
+    bool probe_wrong;
+    // Capabilities from the last ATR of each slot
+    SeaderAtr atr[SEADER_CCID_SLOTS];
+    // APDU being sent in blocks of at most IFSC, the next one goes out on the empty DataBlock.
+    // Also holds the APDU a powered off SAM is woken for.
+    uint8_t tx_chain[SEADER_APDU_MAX_LEN];
+    size_t tx_chain_len;
+    size_t tx_chain_pos;
+    uint8_t chain_slot;
+    // Response blocks collected until the one with CCID_CHAIN_END
+    uint8_t rx_chain[SEADER_APDU_MAX_LEN];
+    size_t rx_chain_len;
+    // Copied from the entry loaded at startup on the SAM's ATR, cache_hit when its hash matched
+    SeaderSamCache cache;
+    bool cache_hit;
+    // An XfrBlock is out and the SAM has not answered it yet
+    volatile bool apdu_pending;
+    // PC_to_RDR_Abort sent, apdu_pending clears on its SlotStatus
+    bool aborting;
+    // Fires WorkerEvtSamIdle once the SAM has been idle for cfg.sam_idle_off_ms
+    FuriTimer* idle_timer;
+    // When the wake started, for the latency in st
+    uint32_t wake_tick;
+} SeaderCcidContext;
+
 struct SeaderUartBridge {
     SeaderUartConfig cfg;
     SeaderUartConfig cfg_new;
+    struct Seader* seader;
+
+    const SeaderTransport* transport;
+    // Owned by the transport, NULL for the UART one
+    void* transport_context;
 
     FuriThread* thread;
+    // NULL in SeaderUartThreadModeSingle
     FuriThread* tx_thread;
 
-    FuriStreamBuffer* rx_stream;
+    SeaderUartRing rx_ring;
     FuriHalSerialHandle* serial_handle;
 
+    // Counts descriptors in tx_pool that are neither held nor queued
     FuriSemaphore* tx_sem;
 
     SeaderUartState st;
 
+    // Only used to linearize a frame that wraps around the end of rx_ring
     uint8_t rx_buf[SEADER_UART_RX_BUF_SIZE];
-    uint8_t tx_buf[SEADER_UART_RX_BUF_SIZE];
-    size_t tx_len;
+    SeaderUartTxDesc tx_pool[SEADER_UART_TX_POOL_LEN];
+    // Submitted descriptors in the order they go out, each one is in at most once.
+    // Free running: tx_head is where the next submit goes, tx_tail the one the DMA is on.
+    SeaderUartTxDesc* tx_fifo[SEADER_UART_TX_POOL_LEN];
+    volatile uint32_t tx_head;
+    volatile uint32_t tx_tail;
+    // A descriptor is being clocked out by the TX DMA
+    volatile bool tx_busy;
+    // A line error hit the frame being received, resync once the line goes idle
+    volatile bool rx_error;
+
+    // Active low GPIO flow control picked by cfg.flow_pins, NULL when disabled
+    const GpioPin* rts_pin;
+    const GpioPin* cts_pin;
+    volatile bool rts_off;
+
+    SeaderUartBaudrateState baudrate_state;
+    uint32_t baudrate_candidate;
+    uint32_t baudrate_previous;
+
+    // CCID state of the reader on this UART
+    SeaderCcidContext ccid;
+
+    // SAM responses waiting for the conversation running on this bridge
+    FuriMessageQueue* messages;
+    FuriMutex* mq_mutex;
+
+    // Hex dumps made on this bridge's worker
+    char display[SEADER_DISPLAY_LEN];
 };
 
-typedef struct SeaderUartBridge SeaderUartBridge;
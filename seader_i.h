@@ -50,12 +50,14 @@
 #include "seader.h"
 #include "ccid.h"
 #include "uart.h"
+#include "transport.h"
 #include "seader_worker.h"
 #include "seader_credential.h"
 
 #define WORKER_ALL_RX_EVENTS                                                      \
     (WorkerEvtStop | WorkerEvtRxDone | WorkerEvtCfgChange | WorkerEvtLineCfgSet | \
-     WorkerEvtCtrlLineSet | WorkerEvtSamTxComplete)
+     WorkerEvtCtrlLineSet | WorkerEvtSamTxComplete | WorkerEvtRxError |           \
+     WorkerEvtCcidTimeout | WorkerEvtSamIdle | WorkerEvtCcidAbort | WorkerEvtSamSelect)
 #define WORKER_ALL_TX_EVENTS (WorkerEvtTxStop | WorkerEvtSamRx)
 
 #define SEADER_TEXT_STORE_SIZE 128
@@ -84,6 +86,16 @@ typedef enum {
 
     WorkerEvtLineCfgSet = (1 << 6),
     WorkerEvtCtrlLineSet = (1 << 7),
+
+    WorkerEvtRxError = (1 << 8),
+    // A CCID command is past its answer deadline
+    WorkerEvtCcidTimeout = (1 << 9),
+    // The SAM has been idle long enough to be powered off
+    WorkerEvtSamIdle = (1 << 10),
+    // The card went away, drop the exchange with the SAM
+    WorkerEvtCcidAbort = (1 << 11),
+    // seader_uart_select_idle picked another slot for the next conversation
+    WorkerEvtSamSelect = (1 << 12),
 } WorkerEvtFlags;
 
 struct Seader {
@@ -95,8 +107,13 @@ struct Seader {
     NotificationApp* notifications;
     SceneManager* scene_manager;
     SeaderUartBridge* uart;
+    // Second SAM on the USART, only opened when built with SEADER_UART_DUAL
+    SeaderUartBridge* uart2;
     SeaderCredential* credential;
     SamCommand_PR samCommand;
+    // Read before the bridges start and written back on exit, they never touch storage
+    SeaderSamCache sam_cache;
+    bool sam_cache_dirty;
 
     char text_store[SEADER_TEXT_STORE_SIZE + 1];
     FuriString* text_box_store;
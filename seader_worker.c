@@ -7,20 +7,11 @@
 
 #define APDU_HEADER_LEN 5
 #define ASN1_PREFIX 6
-#define ASN1_DEBUG true
 
 #define RFAL_PICOPASS_TXRX_FLAGS                                                    \
     (FURI_HAL_NFC_LL_TXRX_FLAGS_CRC_TX_MANUAL | FURI_HAL_NFC_LL_TXRX_FLAGS_AGC_ON | \
      FURI_HAL_NFC_LL_TXRX_FLAGS_PAR_RX_REMV | FURI_HAL_NFC_LL_TXRX_FLAGS_CRC_RX_KEEP)
 
-// TODO: const
-uint8_t GET_RESPONSE[] = {0x00, 0xc0, 0x00, 0x00, 0xff};
-
-char display[SEADER_UART_RX_BUF_SIZE * 2 + 1] = {0};
-
-// Forward declaration
-void seader_send_card_detected(SeaderUartBridge* seader_uart, CardDetails_t* cardDetails);
-
 /***************************** Seader Worker API *******************************/
 
 SeaderWorker* seader_worker_alloc() {
@@ -29,8 +20,6 @@ SeaderWorker* seader_worker_alloc() {
     // Worker thread attributes
     seader_worker->thread =
         furi_thread_alloc_ex("SeaderWorker", 8192, seader_worker_task, seader_worker);
-    seader_worker->messages = furi_message_queue_alloc(3, sizeof(SeaderAPDU));
-    seader_worker->mq_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
 
     seader_worker->callback = NULL;
     seader_worker->context = NULL;
@@ -46,8 +35,6 @@ void seader_worker_free(SeaderWorker* seader_worker) {
     furi_assert(seader_worker);
 
     furi_thread_free(seader_worker->thread);
-    furi_message_queue_free(seader_worker->messages);
-    furi_mutex_free(seader_worker->mq_mutex);
 
     furi_record_close(RECORD_STORAGE);
 
@@ -92,65 +79,90 @@ void seader_worker_change_state(SeaderWorker* seader_worker, SeaderWorkerState s
 
 /***************************** Seader Worker Thread *******************************/
 
-bool seader_process_success_response(Seader* seader, uint8_t* apdu, size_t len) {
-    SeaderWorker* seader_worker = seader->worker;
-
+bool seader_process_success_response(
+    Seader* seader,
+    SeaderUartBridge* seader_uart,
+    uint8_t* apdu,
+    size_t len) {
     if(seader_process_success_response_i(seader, apdu, len, false, NULL)) {
         // no-op, message was processed
     } else {
         FURI_LOG_I(TAG, "Enqueue SAM message, %d bytes", len);
-        uint32_t space = furi_message_queue_get_space(seader_worker->messages);
+        uint32_t space = furi_message_queue_get_space(seader_uart->messages);
         if(space > 0) {
             SeaderAPDU seaderApdu = {};
             seaderApdu.len = len;
             memcpy(seaderApdu.buf, apdu, len);
 
-            if(furi_mutex_acquire(seader_worker->mq_mutex, FuriWaitForever) == FuriStatusOk) {
-                furi_message_queue_put(seader_worker->messages, &seaderApdu, FuriWaitForever);
-                furi_mutex_release(seader_worker->mq_mutex);
+            if(furi_mutex_acquire(seader_uart->mq_mutex, FuriWaitForever) == FuriStatusOk) {
+                furi_message_queue_put(seader_uart->messages, &seaderApdu, FuriWaitForever);
+                furi_mutex_release(seader_uart->mq_mutex);
             }
         }
     }
     return true;
 }
 
-bool seader_worker_process_sam_message(Seader* seader, CCID_Message* message) {
+bool seader_worker_process_sam_message(
+    Seader* seader,
+    SeaderUartBridge* seader_uart,
+    CCID_Message* message) {
     size_t len = message->dwLength;
     uint8_t* apdu = message->payload;
-    SeaderWorker* seader_worker = seader->worker;
-    SeaderUartBridge* seader_uart = seader_worker->uart;
     if(len < 2) {
         return false;
     }
-    memset(display, 0, sizeof(display));
-    for(uint8_t i = 0; i < len; i++) {
-        snprintf(display + (i * 2), sizeof(display), "%02x", apdu[i]);
-    }
-    // FURI_LOG_I(TAG, "APDU: %s", display);
-
     uint8_t SW1 = apdu[len - 2];
     uint8_t SW2 = apdu[len - 1];
 
     switch(SW1) {
-    case 0x61:
+    case 0x61: {
         // FURI_LOG_I(TAG, "Request %d bytes", SW2);
-        GET_RESPONSE[4] = SW2;
-        seader_ccid_XfrBlock(seader_uart, GET_RESPONSE, sizeof(GET_RESPONSE));
+        uint8_t get_response[] = {0x00, 0xc0, 0x00, 0x00, SW2};
+        seader_ccid_XfrBlock(&seader_uart->ccid, get_response, sizeof(get_response));
         return true;
-        break;
+    }
 
     case 0x90:
         if(SW2 == 0x00) {
             if(len > 2) {
-                return seader_process_success_response(seader, apdu, len - 2);
+                return seader_process_success_response(seader, seader_uart, apdu, len - 2);
             }
         }
         break;
     }
 
+    if(seader_uart == seader->uart) {
+        seader_worker_version_failed(seader);
+    }
     return false;
 }
 
+/* The SAM answered the version query with an error or not at all, so it is not one we can use */
+void seader_worker_version_failed(Seader* seader) {
+    SeaderWorker* seader_worker = seader->worker;
+
+    if(seader->samCommand != SamCommand_PR_version) {
+        return;
+    }
+    FURI_LOG_W(TAG, "SAM version query failed");
+    seader->samCommand = SamCommand_PR_NOTHING;
+    if(seader_worker->callback) {
+        seader_worker->callback(SeaderWorkerEventSamWrong, seader_worker->context);
+    }
+}
+
+/* The card went away mid conversation, so the SAM is told instead of left waiting for NFCRx */
+void seader_worker_abort(Seader* seader) {
+    SeaderWorker* seader_worker = seader->worker;
+    SeaderUartBridge* seader_uart = seader_worker->uart;
+
+    FURI_LOG_W(TAG, "Aborting SAM exchange");
+    seader_worker->stage = SeaderPollerEventTypeFail;
+    // The CCID context belongs to the UART worker, so it does the Abort
+    furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtCcidAbort);
+}
+
 void seader_worker_virtual_credential(Seader* seader) {
     SeaderWorker* seader_worker = seader->worker;
 
@@ -163,14 +175,15 @@ void seader_worker_virtual_credential(Seader* seader) {
     uint8_t dead_loops = 20;
 
     while(running) {
-        if(furi_mutex_acquire(seader_worker->mq_mutex, 0) == FuriStatusOk) {
-            uint32_t count = furi_message_queue_get_count(seader_worker->messages);
+        SeaderUartBridge* seader_uart = seader_worker->uart;
+        if(furi_mutex_acquire(seader_uart->mq_mutex, 0) == FuriStatusOk) {
+            uint32_t count = furi_message_queue_get_count(seader_uart->messages);
             if(count > 0) {
                 FURI_LOG_I(TAG, "Dequeue SAM message [%ld messages]", count);
 
                 SeaderAPDU seaderApdu = {};
                 FuriStatus status =
-                    furi_message_queue_get(seader_worker->messages, &seaderApdu, FuriWaitForever);
+                    furi_message_queue_get(seader_uart->messages, &seaderApdu, FuriWaitForever);
                 if(status != FuriStatusOk) {
                     FURI_LOG_W(TAG, "furi_message_queue_get fail %d", status);
                     view_dispatcher_send_custom_event(
@@ -184,7 +197,7 @@ void seader_worker_virtual_credential(Seader* seader) {
                     running = false;
                 }
             }
-            furi_mutex_release(seader_worker->mq_mutex);
+            furi_mutex_release(seader_uart->mq_mutex);
         } else {
             dead_loops--;
             running = (dead_loops > 0);
@@ -208,7 +221,10 @@ int32_t seader_worker_task(void* context) {
 
     if(seader_worker->state == SeaderWorkerStateCheckSam) {
         FURI_LOG_D(TAG, "Check for SAM");
-        seader_ccid_check_for_sam(seader_uart);
+        seader_ccid_check_for_sam(&seader_uart->ccid);
+        if(seader->uart2) {
+            seader_ccid_check_for_sam(&seader->uart2->ccid);
+        }
     } else if(seader_worker->state == SeaderWorkerStateVirtualCredential) {
         FURI_LOG_D(TAG, "Virtual Credential");
         seader_worker_virtual_credential(seader);
@@ -221,15 +237,17 @@ int32_t seader_worker_task(void* context) {
 void seader_worker_poller_conversation(Seader* seader, SeaderPollerContainer* spc) {
     SeaderWorker* seader_worker = seader->worker;
 
-    if(furi_mutex_acquire(seader_worker->mq_mutex, 0) == FuriStatusOk) {
+    SeaderUartBridge* seader_uart = seader_worker->uart;
+
+    if(furi_mutex_acquire(seader_uart->mq_mutex, 0) == FuriStatusOk) {
         furi_thread_set_current_priority(FuriThreadPriorityHighest);
-        uint32_t count = furi_message_queue_get_count(seader_worker->messages);
+        uint32_t count = furi_message_queue_get_count(seader_uart->messages);
         if(count > 0) {
             FURI_LOG_I(TAG, "Dequeue SAM message [%ld messages]", count);
 
             SeaderAPDU seaderApdu = {};
             FuriStatus status =
-                furi_message_queue_get(seader_worker->messages, &seaderApdu, FuriWaitForever);
+                furi_message_queue_get(seader_uart->messages, &seaderApdu, FuriWaitForever);
             if(status != FuriStatusOk) {
                 FURI_LOG_W(TAG, "furi_message_queue_get fail %d", status);
                 seader_worker->stage = SeaderPollerEventTypeComplete;
@@ -247,7 +265,7 @@ void seader_worker_poller_conversation(Seader* seader, SeaderPollerContainer* sp
                 seader_worker->stage = SeaderPollerEventTypeComplete;
             }
         }
-        furi_mutex_release(seader_worker->mq_mutex);
+        furi_mutex_release(seader_uart->mq_mutex);
     } else {
         furi_thread_set_current_priority(FuriThreadPriorityLowest);
     }
@@ -285,6 +303,8 @@ NfcCommand seader_worker_poller_callback_iso14443_4a(NfcGenericEvent event, void
             seader_worker_poller_conversation(seader, &spc);
         } else if(seader_worker->stage == SeaderPollerEventTypeComplete) {
             ret = NfcCommandStop;
+        } else if(seader_worker->stage == SeaderPollerEventTypeFail) {
+            ret = NfcCommandStop;
         }
     } else if(iso14443_4a_event->type == Iso14443_4aPollerEventTypeError) {
         Iso14443_4aPollerEventData* data = iso14443_4a_event->data;
@@ -302,6 +322,9 @@ NfcCommand seader_worker_poller_callback_iso14443_4a(NfcGenericEvent event, void
         case Iso14443_4aErrorTimeout:
             break;
         }
+        if(seader_worker->stage == SeaderPollerEventTypeConversation) {
+            seader_worker_abort(seader);
+        }
     }
 
     return ret;
@@ -334,6 +357,9 @@ NfcCommand seader_worker_poller_callback_mfc(NfcGenericEvent event, void* contex
             ret = NfcCommandStop;
         }
     } else if(mfc_event->type == MfClassicPollerEventTypeFail) {
+        if(seader_worker->stage == SeaderPollerEventTypeConversation) {
+            seader_worker_abort(seader);
+        }
         ret = NfcCommandStop;
     }
 
@@ -364,6 +390,9 @@ NfcCommand seader_worker_poller_callback_picopass(PicopassPollerEvent event, voi
             ret = NfcCommandStop;
         }
     } else if(event.type == PicopassPollerEventTypeFail) {
+        if(seader_worker->stage == SeaderPollerEventTypeConversation) {
+            seader_worker_abort(seader);
+        }
         ret = NfcCommandStop;
         FURI_LOG_W(TAG, "PicopassPollerEventTypeFail");
     } else {
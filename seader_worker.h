@@ -62,8 +62,14 @@ void seader_worker_start(
     void* context);
 
 void seader_worker_stop(SeaderWorker* seader_worker);
-bool seader_worker_process_sam_message(Seader* seader, CCID_Message* message);
+bool seader_worker_process_sam_message(
+    Seader* seader,
+    SeaderUartBridge* seader_uart,
+    CCID_Message* message);
+void seader_worker_abort(Seader* seader);
+void seader_worker_version_failed(Seader* seader);
 void seader_worker_send_version(Seader* seader);
+void seader_worker_send_serial_number(Seader* seader);
 
 NfcCommand seader_worker_poller_callback_iso14443_4a(NfcGenericEvent event, void* context);
 NfcCommand seader_worker_poller_callback_mfc(NfcGenericEvent event, void* context);
@@ -20,20 +20,23 @@ struct SeaderWorker {
     FuriThread* thread;
     Storage* storage;
     uint8_t sam_version[2];
-    FuriMessageQueue* messages;
-    FuriMutex* mq_mutex;
 
+    // Bridge the current SAM conversation runs on, picked per card by seader_uart_select_idle
+    // along with the slot of its ccid
     SeaderUartBridge* uart;
     SeaderWorkerCallback callback;
     void* context;
 
     SeaderPollerEventType stage;
     SeaderWorkerState state;
+
+    // Hex dumps made on the NFC poller or this thread, they never run at the same time
+    char display[SEADER_DISPLAY_LEN];
 };
 
 struct SeaderAPDU {
     size_t len;
-    uint8_t buf[SEADER_POLLER_MAX_BUFFER_SIZE];
+    uint8_t buf[SEADER_APDU_MAX_LEN];
 };
 
 void seader_worker_change_state(SeaderWorker* seader_worker, SeaderWorkerState state);
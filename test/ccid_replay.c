@@ -0,0 +1,386 @@
+/*
+ * Host run of the CCID parser against a recorded trace, through the same replay transport the
+ * app is built with under SEADER_TRANSPORT_REPLAY. The harness probes for a SAM, then sends the
+ * APDU of every XfrBlock the trace expects next, so a session captured on the Flipper plays
+ * back as is. Run with `make test`, or `./ccid_replay trace.txt`.
+ *
+ * The furi pieces ccid.c and transport_replay.c use are stood in for below, single threaded:
+ * thread flags are collected and handled the way seader_uart_worker would, timers never fire.
+ */
+#include <stdarg.h>
+#include <ctype.h>
+
+static const char* host_trace_path = "test/ccid_replay.txt";
+#define SEADER_REPLAY_PATH host_trace_path
+
+// Included for SeaderReplay, the harness checks the trace was played to the end
+#include "../transport_replay.c"
+
+static uint32_t host_flags;
+static uint32_t host_warnings;
+static uint32_t host_versions;
+static uint32_t host_sam_messages;
+
+void host_log(char level, const char* tag, const char* format, ...) {
+    if(level == 'W' || level == 'E') {
+        host_warnings++;
+    } else if(level != 'I') {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    printf("[%c][%s] ", level, tag);
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+}
+
+/* furi */
+
+struct FuriMutex {
+    uint32_t count;
+};
+
+struct FuriSemaphore {
+    uint32_t max;
+    uint32_t count;
+};
+
+struct FuriTimer {
+    bool running;
+};
+
+struct FuriString {
+    char* str;
+    size_t size;
+};
+
+struct Stream {
+    FILE* file;
+};
+
+FuriThreadId furi_thread_get_id(FuriThread* thread) {
+    return thread;
+}
+
+FuriThreadId furi_thread_get_current_id(void) {
+    return NULL;
+}
+
+uint32_t furi_thread_flags_set(FuriThreadId thread_id, uint32_t flags) {
+    UNUSED(thread_id);
+    host_flags |= flags;
+    return host_flags;
+}
+
+uint32_t furi_get_tick(void) {
+    return 0;
+}
+
+uint32_t furi_ms_to_ticks(uint32_t milliseconds) {
+    return milliseconds;
+}
+
+FuriMutex* furi_mutex_alloc(FuriMutexType type) {
+    UNUSED(type);
+    return calloc(1, sizeof(FuriMutex));
+}
+
+void furi_mutex_free(FuriMutex* instance) {
+    furi_check(instance->count == 0);
+    free(instance);
+}
+
+FuriStatus furi_mutex_acquire(FuriMutex* instance, uint32_t timeout) {
+    UNUSED(timeout);
+    instance->count++;
+    return FuriStatusOk;
+}
+
+FuriStatus furi_mutex_release(FuriMutex* instance) {
+    furi_check(instance->count > 0);
+    instance->count--;
+    return FuriStatusOk;
+}
+
+FuriSemaphore* furi_semaphore_alloc(uint32_t max_count, uint32_t initial_count) {
+    FuriSemaphore* instance = malloc(sizeof(FuriSemaphore));
+    instance->max = max_count;
+    instance->count = initial_count;
+    return instance;
+}
+
+void furi_semaphore_free(FuriSemaphore* instance) {
+    free(instance);
+}
+
+FuriStatus furi_semaphore_acquire(FuriSemaphore* instance, uint32_t timeout) {
+    UNUSED(timeout);
+    // Nobody else could ever release it
+    if(instance->count == 0) {
+        return FuriStatusErrorTimeout;
+    }
+    instance->count--;
+    return FuriStatusOk;
+}
+
+FuriStatus furi_semaphore_release(FuriSemaphore* instance) {
+    furi_check(instance->count < instance->max);
+    instance->count++;
+    return FuriStatusOk;
+}
+
+FuriTimer* furi_timer_alloc(FuriTimerCallback func, FuriTimerType type, void* context) {
+    UNUSED(func);
+    UNUSED(type);
+    UNUSED(context);
+    return calloc(1, sizeof(FuriTimer));
+}
+
+void furi_timer_free(FuriTimer* instance) {
+    free(instance);
+}
+
+FuriStatus furi_timer_start(FuriTimer* instance, uint32_t ticks) {
+    UNUSED(ticks);
+    instance->running = true;
+    return FuriStatusOk;
+}
+
+FuriStatus furi_timer_stop(FuriTimer* instance) {
+    instance->running = false;
+    return FuriStatusOk;
+}
+
+uint32_t furi_timer_is_running(FuriTimer* instance) {
+    return instance->running;
+}
+
+FuriString* furi_string_alloc(void) {
+    return calloc(1, sizeof(FuriString));
+}
+
+void furi_string_free(FuriString* string) {
+    free(string->str);
+    free(string);
+}
+
+const char* furi_string_get_cstr(const FuriString* string) {
+    return string->str ? string->str : "";
+}
+
+char furi_string_get_char(const FuriString* string, size_t index) {
+    return furi_string_get_cstr(string)[index];
+}
+
+void furi_string_trim(FuriString* string) {
+    if(!string->str) {
+        return;
+    }
+    char* start = string->str;
+    while(isspace((unsigned char)*start)) {
+        start++;
+    }
+    size_t len = strlen(start);
+    while(len > 0 && isspace((unsigned char)start[len - 1])) {
+        len--;
+    }
+    memmove(string->str, start, len);
+    string->str[len] = '\0';
+}
+
+void* furi_record_open(const char* name) {
+    UNUSED(name);
+    return NULL;
+}
+
+void furi_record_close(const char* name) {
+    UNUSED(name);
+}
+
+Stream* file_stream_alloc(Storage* storage) {
+    UNUSED(storage);
+    return calloc(1, sizeof(Stream));
+}
+
+bool file_stream_open(Stream* stream, const char* path, FS_AccessMode mode, FS_OpenMode open) {
+    UNUSED(mode);
+    UNUSED(open);
+    stream->file = fopen(path, "r");
+    return stream->file != NULL;
+}
+
+bool file_stream_close(Stream* stream) {
+    if(stream->file) {
+        fclose(stream->file);
+        stream->file = NULL;
+    }
+    return true;
+}
+
+void stream_free(Stream* stream) {
+    file_stream_close(stream);
+    free(stream);
+}
+
+bool stream_read_line(Stream* stream, FuriString* str) {
+    ssize_t len = getline(&str->str, &str->size, stream->file);
+    return len > 0;
+}
+
+bool hex_chars_to_uint8(char hi, char lo, uint8_t* value) {
+    if(!isxdigit((unsigned char)hi) || !isxdigit((unsigned char)lo)) {
+        return false;
+    }
+    char hex[3] = {hi, lo, '\0'};
+    *value = strtoul(hex, NULL, 16);
+    return true;
+}
+
+/* uart.c, same ring as on the Flipper */
+
+size_t seader_uart_ring_count(SeaderUartRing* ring) {
+    return ring->head - ring->tail;
+}
+
+uint8_t seader_uart_ring_peek(SeaderUartRing* ring, size_t offset) {
+    return ring->buf[(ring->tail + offset) & SEADER_UART_RX_RING_MASK];
+}
+
+uint8_t* seader_uart_ring_get(SeaderUartRing* ring, size_t offset, size_t len, uint8_t* scratch) {
+    size_t start = (ring->tail + offset) & SEADER_UART_RX_RING_MASK;
+    if(start + len <= SEADER_UART_RX_RING_SIZE) {
+        return ring->buf + start;
+    }
+    size_t first = SEADER_UART_RX_RING_SIZE - start;
+    memcpy(scratch, ring->buf + start, first);
+    memcpy(scratch + first, ring->buf, len - first);
+    return scratch;
+}
+
+void seader_uart_record_latency(SeaderUartBridge* seader_uart, uint32_t sent_tick) {
+    UNUSED(sent_tick);
+    seader_uart->st.apdu_cnt++;
+}
+
+/* seader_worker.c and sam_api.c, only counted */
+
+void seader_worker_send_version(Seader* seader) {
+    UNUSED(seader);
+    host_versions++;
+}
+
+void seader_worker_send_serial_number(Seader* seader) {
+    UNUSED(seader);
+    host_versions++;
+}
+
+void seader_worker_version_failed(Seader* seader) {
+    UNUSED(seader);
+}
+
+void seader_worker_abort(Seader* seader) {
+    UNUSED(seader);
+}
+
+bool seader_sam_cache_lookup(Seader* seader, uint32_t atr_hash, SeaderSamCache* cache) {
+    UNUSED(seader);
+    UNUSED(atr_hash);
+    UNUSED(cache);
+    return false;
+}
+
+bool seader_worker_process_sam_message(
+    Seader* seader,
+    SeaderUartBridge* seader_uart,
+    CCID_Message* message) {
+    UNUSED(seader);
+    UNUSED(seader_uart);
+    UNUSED(message);
+    host_sam_messages++;
+    return true;
+}
+
+/* Handles the flags raised so far the way seader_uart_worker does, until none are left */
+static void host_run(SeaderUartBridge* seader_uart) {
+    SeaderUartRing* ring = &seader_uart->rx_ring;
+    while(host_flags) {
+        uint32_t events = host_flags;
+        host_flags = 0;
+        if(events & WorkerEvtSamSelect) {
+            seader_ccid_select(&seader_uart->ccid);
+        }
+        if(events & WorkerEvtRxDone) {
+            size_t consumed = 0;
+            do {
+                if(seader_uart_ring_count(ring) < 2) {
+                    break;
+                }
+                consumed = seader_ccid_process(seader_uart->seader, &seader_uart->ccid);
+                ring->tail += consumed;
+                seader_uart->st.rx_cnt += consumed;
+            } while(consumed > 0);
+        }
+    }
+}
+
+/* Sends the APDU of the XfrBlock the trace expects next, false when it expects anything else */
+static bool host_next_apdu(SeaderUartBridge* seader_uart) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    if(!seader_replay_next(replay) || furi_string_get_char(replay->line, 0) != '>') {
+        return false;
+    }
+    uint8_t frame[SEADER_UART_RX_BUF_SIZE];
+    size_t len = seader_replay_parse(furi_string_get_cstr(replay->line) + 1, frame, sizeof(frame));
+    if(len < SEADER_CCID_FRAME_OVERHEAD || frame[2] != CCID_MESSAGE_TYPE_PC_to_RDR_XfrBlock) {
+        return false;
+    }
+    seader_ccid_XfrBlock(
+        &seader_uart->ccid, frame + SEADER_CCID_HEADER_LEN, len - SEADER_CCID_FRAME_OVERHEAD);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 1) {
+        host_trace_path = argv[1];
+    }
+
+    Seader* seader = calloc(1, sizeof(Seader));
+    SeaderWorker* seader_worker = calloc(1, sizeof(SeaderWorker));
+    SeaderUartBridge* seader_uart = calloc(1, sizeof(SeaderUartBridge));
+    seader->worker = seader_worker;
+    seader->uart = seader_uart;
+    seader_worker->uart = seader_uart;
+    seader_uart->seader = seader;
+    seader_uart->transport = &seader_replay_transport;
+    seader_ccid_context_init(&seader_uart->ccid, seader_uart);
+
+    seader_uart->transport->open(seader_uart);
+    SeaderReplay* replay = seader_uart->transport_context;
+    if(!replay->stream) {
+        return 1;
+    }
+    seader_ccid_check_for_sam(&seader_uart->ccid);
+    host_run(seader_uart);
+    while(host_next_apdu(seader_uart)) {
+        host_run(seader_uart);
+    }
+
+    bool ok = replay->mismatched == 0 && !seader_replay_next(replay) &&
+              seader_uart->ccid.has_sam && host_versions == 1 &&
+              host_sam_messages == seader_uart->st.apdu_cnt;
+    printf(
+        "%s %u frames, %u APDUs, %u NAKs resent, %u warnings\n",
+        ok ? "ok  " : "FAIL",
+        replay->frames,
+        seader_uart->st.apdu_cnt,
+        seader_uart->st.nak_resends,
+        host_warnings);
+
+    seader_uart->transport->close(seader_uart);
+    seader_ccid_context_free(&seader_uart->ccid);
+    free(seader_uart);
+    free(seader_worker);
+    free(seader);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/*
+ * Host check that the pre-encoded payloads in sam_der.c match what asn1c produces from
+ * seader.asn1. Run with `make test` after regenerating lib/asn1.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <FrameProtocol.h>
+#include <Payload.h>
+
+#include "sam_der.h"
+
+static bool check(const char* name, Payload_t* payload, const uint8_t* der, size_t len) {
+    uint8_t encoded[SEADER_DER_CARD_DETECTED_MAX] = {0};
+    asn_enc_rval_t er = der_encode_to_buffer(&asn_DEF_Payload, payload, encoded, sizeof(encoded));
+    if(er.encoded != (ssize_t)len || memcmp(encoded, der, len) != 0) {
+        printf("FAIL %s\n", name);
+        return false;
+    }
+    printf("ok   %s\n", name);
+    return true;
+}
+
+int main(void) {
+    bool ok = true;
+    Payload_t payload;
+
+    memset(&payload, 0, sizeof(payload));
+    payload.present = Payload_PR_samCommand;
+    payload.choice.samCommand.present = SamCommand_PR_version;
+    ok &= check("version", &payload, seader_der_version, sizeof(seader_der_version));
+
+    payload.choice.samCommand.present = SamCommand_PR_serialNumber;
+    ok &= check(
+        "serialNumber", &payload, seader_der_serial_number, sizeof(seader_der_serial_number));
+
+    payload.choice.samCommand.present = SamCommand_PR_requestPacs;
+    payload.choice.samCommand.choice.requestPacs.contentElementTag =
+        ContentElementTag_implicitFormatPhysicalAccessBits;
+    ok &= check("requestPacs", &payload, seader_der_request_pacs, sizeof(seader_der_request_pacs));
+
+    memset(&payload, 0, sizeof(payload));
+    payload.present = Payload_PR_response;
+    payload.choice.response.present = Response_PR_nfcResponse;
+    payload.choice.response.choice.nfcResponse.present = NFCResponse_PR_nfcAck;
+    ok &= check("nfcAck", &payload, seader_der_nfc_ack, sizeof(seader_der_nfc_ack));
+
+    // Longest CardDetails a card sends, a 10 byte UID with ATQA and SAK
+    uint8_t protocol_bytes[] = {0x00, FrameProtocol_nfc};
+    uint8_t csn[10] = {0x04, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09};
+    uint8_t atqa[] = {0x44, 0x03};
+    uint8_t sak = 0x20;
+    OCTET_STRING_t atqa_string = {.buf = atqa, .size = sizeof(atqa)};
+    OCTET_STRING_t sak_string = {.buf = &sak, .size = 1};
+    memset(&payload, 0, sizeof(payload));
+    payload.present = Payload_PR_samCommand;
+    payload.choice.samCommand.present = SamCommand_PR_cardDetected;
+    CardDetails_t* cardDetails =
+        &payload.choice.samCommand.choice.cardDetected.detectedCardDetails;
+    cardDetails->protocol.buf = protocol_bytes;
+    cardDetails->protocol.size = sizeof(protocol_bytes);
+    cardDetails->csn.buf = csn;
+    cardDetails->csn.size = sizeof(csn);
+    cardDetails->atqa = &atqa_string;
+    cardDetails->sak = &sak_string;
+
+    uint8_t der[SEADER_DER_CARD_DETECTED_MAX];
+    size_t len =
+        seader_der_encode_card_detected(der, FrameProtocol_nfc, csn, sizeof(csn), atqa, &sak);
+    ok &= check("cardDetected", &payload, der, len);
+
+    // Picopass sends neither ATQA nor SAK
+    cardDetails->protocol.buf[1] = FrameProtocol_iclass;
+    cardDetails->csn.size = 8;
+    cardDetails->atqa = NULL;
+    cardDetails->sak = NULL;
+    len = seader_der_encode_card_detected(der, FrameProtocol_iclass, csn, 8, NULL, NULL);
+    ok &= check("cardDetected picopass", &payload, der, len);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+/*
+ * Just enough of the Flipper SDK for ccid.c and transport_replay.c to build on a PC, see
+ * test/ccid_replay.c. Types the CCID path never touches are left opaque.
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNUSED(x) (void)(x)
+#define COUNT_OF(x) (sizeof(x) / sizeof(x[0]))
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define furi_assert(x) furi_check(x)
+#define furi_check(x)                                                             \
+    do {                                                                          \
+        if(!(x)) {                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            abort();                                                              \
+        }                                                                         \
+    } while(0)
+
+void host_log(char level, const char* tag, const char* format, ...);
+#define FURI_LOG_E(tag, ...) host_log('E', tag, __VA_ARGS__)
+#define FURI_LOG_W(tag, ...) host_log('W', tag, __VA_ARGS__)
+#define FURI_LOG_I(tag, ...) host_log('I', tag, __VA_ARGS__)
+#define FURI_LOG_D(tag, ...) host_log('D', tag, __VA_ARGS__)
+#define FURI_LOG_T(tag, ...) host_log('T', tag, __VA_ARGS__)
+
+// Single threaded, nothing to keep out
+#define FURI_CRITICAL_ENTER()
+#define FURI_CRITICAL_EXIT()
+#define FURI_PACKED __attribute__((packed))
+
+#define FuriWaitForever 0xFFFFFFFFU
+#define RECORD_STORAGE "storage"
+#define APP_DATA_PATH(path) path
+
+typedef enum {
+    FuriStatusOk = 0,
+    FuriStatusError = -1,
+    FuriStatusErrorTimeout = -2,
+} FuriStatus;
+
+typedef enum {
+    FuriFlagWaitAny = 0,
+    FuriFlagWaitAll = 1,
+    FuriFlagNoClear = 2,
+    FuriFlagError = (int)0x80000000U,
+    FuriFlagErrorTimeout = (int)0xFFFFFFFEU,
+} FuriFlag;
+
+typedef enum {
+    FuriMutexTypeNormal,
+    FuriMutexTypeRecursive,
+} FuriMutexType;
+
+typedef enum {
+    FuriTimerTypeOnce,
+    FuriTimerTypePeriodic,
+} FuriTimerType;
+
+typedef enum {
+    FuriThreadPriorityNormal,
+    FuriThreadPriorityHighest,
+} FuriThreadPriority;
+
+typedef enum {
+    FuriHalSerialIdUsart,
+    FuriHalSerialIdLpuart,
+    FuriHalSerialIdMax,
+} FuriHalSerialId;
+
+typedef struct FuriThread FuriThread;
+typedef void* FuriThreadId;
+typedef struct FuriMutex FuriMutex;
+typedef struct FuriSemaphore FuriSemaphore;
+typedef struct FuriMessageQueue FuriMessageQueue;
+typedef struct FuriTimer FuriTimer;
+typedef struct FuriString FuriString;
+typedef struct FuriHalSerialHandle FuriHalSerialHandle;
+typedef void (*FuriTimerCallback)(void* context);
+
+FuriThreadId furi_thread_get_id(FuriThread* thread);
+FuriThreadId furi_thread_get_current_id(void);
+uint32_t furi_thread_flags_set(FuriThreadId thread_id, uint32_t flags);
+uint32_t furi_get_tick(void);
+uint32_t furi_ms_to_ticks(uint32_t milliseconds);
+
+FuriMutex* furi_mutex_alloc(FuriMutexType type);
+void furi_mutex_free(FuriMutex* instance);
+FuriStatus furi_mutex_acquire(FuriMutex* instance, uint32_t timeout);
+FuriStatus furi_mutex_release(FuriMutex* instance);
+
+FuriSemaphore* furi_semaphore_alloc(uint32_t max_count, uint32_t initial_count);
+void furi_semaphore_free(FuriSemaphore* instance);
+FuriStatus furi_semaphore_acquire(FuriSemaphore* instance, uint32_t timeout);
+FuriStatus furi_semaphore_release(FuriSemaphore* instance);
+
+FuriTimer* furi_timer_alloc(FuriTimerCallback func, FuriTimerType type, void* context);
+void furi_timer_free(FuriTimer* instance);
+FuriStatus furi_timer_start(FuriTimer* instance, uint32_t ticks);
+FuriStatus furi_timer_stop(FuriTimer* instance);
+uint32_t furi_timer_is_running(FuriTimer* instance);
+
+FuriString* furi_string_alloc(void);
+void furi_string_free(FuriString* string);
+const char* furi_string_get_cstr(const FuriString* string);
+char furi_string_get_char(const FuriString* string, size_t index);
+void furi_string_trim(FuriString* string);
+
+void* furi_record_open(const char* name);
+void furi_record_close(const char* name);
+
+/* storage, a Stream is a stdio file */
+typedef struct Storage Storage;
+typedef struct Stream Stream;
+typedef enum {
+    FSAM_READ = (1 << 0),
+} FS_AccessMode;
+typedef enum {
+    FSOM_OPEN_EXISTING = 1,
+} FS_OpenMode;
+
+Stream* file_stream_alloc(Storage* storage);
+bool file_stream_open(Stream* stream, const char* path, FS_AccessMode mode, FS_OpenMode open);
+bool file_stream_close(Stream* stream);
+void stream_free(Stream* stream);
+bool stream_read_line(Stream* stream, FuriString* str);
+bool hex_chars_to_uint8(char hi, char lo, uint8_t* value);
+
+/* Opaque to the CCID path */
+typedef struct Gui Gui;
+typedef struct View View;
+typedef struct ViewDispatcher ViewDispatcher;
+typedef struct SceneManager SceneManager;
+typedef struct Submenu Submenu;
+typedef struct Popup Popup;
+typedef struct Loading Loading;
+typedef struct TextInput TextInput;
+typedef struct TextBox TextBox;
+typedef struct Widget Widget;
+typedef struct NotificationApp NotificationApp;
+typedef struct SceneManagerHandlers SceneManagerHandlers;
+typedef struct SceneManagerEvent SceneManagerEvent;
+typedef struct DialogsApp DialogsApp;
+typedef struct FlipperFormat FlipperFormat;
+typedef struct PluginManager PluginManager;
+typedef struct Nfc Nfc;
+typedef struct NfcPoller NfcPoller;
+typedef struct NfcDevice NfcDevice;
+typedef struct BitBuffer BitBuffer;
+typedef struct Iso14443_4aPoller Iso14443_4aPoller;
+typedef struct MfClassicPoller MfClassicPoller;
+typedef struct MfClassicData MfClassicData;
+typedef struct Iso14443_3aData Iso14443_3aData;
+typedef struct GpioPin GpioPin;
+
+typedef enum {
+    NfcCommandContinue,
+    NfcCommandReset,
+    NfcCommandStop,
+    NfcCommandSleep,
+} NfcCommand;
+
+typedef enum {
+    NfcProtocolIso14443_3a,
+    NfcProtocolIso14443_4a,
+    NfcProtocolMfClassic,
+    NfcProtocolNum,
+} NfcProtocol;
+
+typedef struct {
+    NfcProtocol protocol;
+    void* instance;
+    void* event_data;
+} NfcGenericEvent;
+
+typedef struct {
+    const char* name;
+    int (*count)(uint8_t bit_length, uint64_t bits);
+    void (*description)(uint8_t bit_length, uint64_t bits, size_t index, FuriString* description);
+} PluginWiegand;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "seader_bridge.h"
+
+/*
+ * Link between a bridge and its CCID reader. ccid.c only builds and parses frames, the
+ * transport decides how they get to the reader and how the answers land in rx_ring.
+ */
+struct SeaderTransport {
+    const char* name;
+    // Called on the bridge's worker thread before the first frame and after the last one
+    void (*open)(SeaderUartBridge* seader_uart);
+    void (*close)(SeaderUartBridge* seader_uart);
+    // Buffer of SEADER_UART_RX_BUF_SIZE bytes for the next frame, may block. Only the first
+    // SEADER_CCID_HEADER_LEN bytes are zeroed, builders write everything past them.
+    // Never called with the ccid lock held, the other ops do not block and may be.
+    uint8_t* (*acquire)(SeaderUartBridge* seader_uart);
+    // Hands a buffer from acquire to the link, len includes the LRC. The buffer stays the
+    // caller's until release, a len of 0 gives it back unsent.
+    void (*send)(SeaderUartBridge* seader_uart, uint8_t* frame, size_t len);
+    // Sends a frame from send again, unless it is still waiting to go out
+    void (*resend)(SeaderUartBridge* seader_uart, uint8_t* frame);
+    // The frame from send has been answered or given up on, its buffer can be reused
+    void (*release)(SeaderUartBridge* seader_uart, uint8_t* frame);
+    // Tick the frame from send last finished going out, for the answer latency
+    uint32_t (*sent_tick)(SeaderUartBridge* seader_uart, uint8_t* frame);
+    // Moves whatever has arrived into rx_ring, returns the bytes waiting there
+    size_t (*receive)(SeaderUartBridge* seader_uart);
+    // Drops the partial frame in rx_ring and asks for the outstanding answer again
+    void (*reset)(SeaderUartBridge* seader_uart);
+    // Lets the last frame leave at the current rate, then moves the local end of the link to
+    // baudrate. Only called between frames, after the answer to the last one.
+    void (*set_baudrate)(SeaderUartBridge* seader_uart, uint32_t baudrate);
+};
+
+// furi_hal_serial and DMA, the default
+extern const SeaderTransport seader_uart_transport;
+#ifdef SEADER_TRANSPORT_REPLAY
+// Plays a recorded trace back from storage, see transport_replay.c
+extern const SeaderTransport seader_replay_transport;
+#endif
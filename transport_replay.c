@@ -0,0 +1,259 @@
+#include "seader_i.h"
+
+// Only built into the app with SEADER_TRANSPORT_REPLAY, and into the host test
+#ifdef SEADER_TRANSPORT_REPLAY
+
+#include <storage/storage.h>
+#include <lib/toolbox/stream/file_stream.h>
+#include <lib/toolbox/hex.h>
+
+#define TAG "SeaderReplay"
+
+#ifndef SEADER_REPLAY_PATH
+#define SEADER_REPLAY_PATH APP_DATA_PATH("replay.txt")
+#endif
+
+/*
+ * Trace format, one CCID frame per line in hex with its direction in front:
+ *   > 0306 6f 05000000 0000 000000 a0da026305 ..   frame the host is expected to send
+ *   < 0306 80 0b000000 0000 000000 ..              bytes the reader answers with
+ * Spaces are ignored and '#' starts a comment. The '<' lines before the first '>' are played
+ * at open, every other run of '<' lines once the '>' frame in front of it has been sent.
+ */
+
+typedef struct {
+    Storage* storage;
+    Stream* stream;
+    // Read ahead, a '>' line waits here until the matching frame is sent
+    FuriString* line;
+    bool pending;
+    // Guards the trace, frames from the NFC and UART worker threads are checked one at a time
+    FuriMutex* mutex;
+    // Same budget as the UART transport, a frame is held from acquire until release
+    uint8_t tx[SEADER_UART_TX_POOL_LEN][SEADER_UART_RX_BUF_SIZE];
+    size_t tx_len[SEADER_UART_TX_POOL_LEN];
+    uint32_t tx_tick[SEADER_UART_TX_POOL_LEN];
+    volatile bool tx_held[SEADER_UART_TX_POOL_LEN];
+    // Counts frames that are not held
+    FuriSemaphore* free;
+    uint8_t expected[SEADER_UART_RX_BUF_SIZE];
+    uint8_t rx[SEADER_UART_RX_BUF_SIZE];
+    uint32_t start;
+    uint32_t frames;
+    uint32_t mismatched;
+} SeaderReplay;
+
+static size_t seader_replay_parse(const char* hex, uint8_t* out, size_t max) {
+    size_t len = 0;
+    while(*hex && len < max) {
+        if(*hex == ' ') {
+            hex++;
+            continue;
+        }
+        if(!hex[1] || !hex_chars_to_uint8(hex[0], hex[1], &out[len])) {
+            break;
+        }
+        len++;
+        hex += 2;
+    }
+    return len;
+}
+
+static bool seader_replay_next(SeaderReplay* replay) {
+    if(replay->pending) {
+        return true;
+    }
+    while(replay->stream && stream_read_line(replay->stream, replay->line)) {
+        furi_string_trim(replay->line);
+        const char* str = furi_string_get_cstr(replay->line);
+        if(str[0] == '<' || str[0] == '>') {
+            replay->pending = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Plays '<' lines into rx_ring up to the next '>' */
+static void seader_replay_feed(SeaderUartBridge* seader_uart) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    SeaderUartRing* ring = &seader_uart->rx_ring;
+    size_t fed = 0;
+
+    while(seader_replay_next(replay)) {
+        const char* str = furi_string_get_cstr(replay->line);
+        if(str[0] != '<') {
+            break;
+        }
+        replay->pending = false;
+
+        size_t len = seader_replay_parse(str + 1, replay->rx, sizeof(replay->rx));
+        if(len > SEADER_UART_RX_RING_SIZE - seader_uart_ring_count(ring)) {
+            FURI_LOG_W(TAG, "rx_ring full, dropping %d bytes", len);
+            continue;
+        }
+        for(size_t i = 0; i < len; i++) {
+            ring->buf[(ring->head + i) & SEADER_UART_RX_RING_MASK] = replay->rx[i];
+        }
+        ring->head += len;
+        fed += len;
+    }
+
+    if(fed > 0) {
+        furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtRxDone);
+    }
+}
+
+static void seader_replay_open(SeaderUartBridge* seader_uart) {
+    SeaderReplay* replay = malloc(sizeof(SeaderReplay));
+    replay->storage = furi_record_open(RECORD_STORAGE);
+    replay->stream = file_stream_alloc(replay->storage);
+    replay->line = furi_string_alloc();
+    replay->pending = false;
+    replay->mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    memset((void*)replay->tx_held, 0, sizeof(replay->tx_held));
+    replay->free = furi_semaphore_alloc(SEADER_UART_TX_POOL_LEN, SEADER_UART_TX_POOL_LEN);
+    replay->start = furi_get_tick();
+    replay->frames = 0;
+    replay->mismatched = 0;
+    seader_uart->transport_context = replay;
+
+    if(!file_stream_open(replay->stream, SEADER_REPLAY_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        FURI_LOG_E(TAG, "Cannot open %s", SEADER_REPLAY_PATH);
+        stream_free(replay->stream);
+        replay->stream = NULL;
+        return;
+    }
+    seader_replay_feed(seader_uart);
+}
+
+static void seader_replay_close(SeaderUartBridge* seader_uart) {
+    SeaderReplay* replay = seader_uart->transport_context;
+
+    FURI_LOG_I(
+        TAG,
+        "%ld frames in %ldms, %ld differed from the trace",
+        replay->frames,
+        furi_get_tick() - replay->start,
+        replay->mismatched);
+
+    if(replay->stream) {
+        file_stream_close(replay->stream);
+        stream_free(replay->stream);
+    }
+    furi_string_free(replay->line);
+    furi_mutex_free(replay->mutex);
+    furi_semaphore_free(replay->free);
+    furi_record_close(RECORD_STORAGE);
+    free(replay);
+    seader_uart->transport_context = NULL;
+}
+
+static size_t seader_replay_index(SeaderReplay* replay, const uint8_t* frame) {
+    size_t index = (frame - replay->tx[0]) / SEADER_UART_RX_BUF_SIZE;
+    furi_check(index < SEADER_UART_TX_POOL_LEN);
+    return index;
+}
+
+static uint8_t* seader_replay_acquire(SeaderUartBridge* seader_uart) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    furi_check(furi_semaphore_acquire(replay->free, FuriWaitForever) == FuriStatusOk);
+
+    uint8_t* frame = NULL;
+    FURI_CRITICAL_ENTER();
+    for(size_t i = 0; i < SEADER_UART_TX_POOL_LEN; i++) {
+        if(!replay->tx_held[i]) {
+            replay->tx_held[i] = true;
+            frame = replay->tx[i];
+            break;
+        }
+    }
+    FURI_CRITICAL_EXIT();
+    furi_check(frame);
+
+    memset(frame, 0, SEADER_CCID_HEADER_LEN);
+    return frame;
+}
+
+static void seader_replay_release(SeaderUartBridge* seader_uart, uint8_t* frame) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    replay->tx_held[seader_replay_index(replay, frame)] = false;
+    furi_semaphore_release(replay->free);
+}
+
+/* Checks a frame the host sent against the next '>' line and plays the answer after it */
+static void seader_replay_check(SeaderUartBridge* seader_uart, const uint8_t* frame, size_t len) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    furi_check(furi_mutex_acquire(replay->mutex, FuriWaitForever) == FuriStatusOk);
+    replay->frames++;
+    seader_uart->st.tx_cnt += len;
+    replay->tx_tick[seader_replay_index(replay, frame)] = furi_get_tick();
+
+    if(seader_replay_next(replay) && furi_string_get_char(replay->line, 0) == '>') {
+        replay->pending = false;
+        size_t expected_len = seader_replay_parse(
+            furi_string_get_cstr(replay->line) + 1, replay->expected, sizeof(replay->expected));
+        if(expected_len != len || memcmp(replay->expected, frame, len) != 0) {
+            FURI_LOG_W(TAG, "Frame %ld differs from the trace", replay->frames);
+            replay->mismatched++;
+        }
+    } else {
+        FURI_LOG_W(TAG, "Frame %ld is past the end of the trace", replay->frames);
+        replay->mismatched++;
+    }
+
+    seader_replay_feed(seader_uart);
+    furi_mutex_release(replay->mutex);
+}
+
+static void seader_replay_send(SeaderUartBridge* seader_uart, uint8_t* frame, size_t len) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    if(len == 0) {
+        seader_replay_release(seader_uart, frame);
+        return;
+    }
+    replay->tx_len[seader_replay_index(replay, frame)] = len;
+    seader_replay_check(seader_uart, frame, len);
+}
+
+static void seader_replay_resend(SeaderUartBridge* seader_uart, uint8_t* frame) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    // A retransmit is in the trace like any other frame
+    seader_replay_check(seader_uart, frame, replay->tx_len[seader_replay_index(replay, frame)]);
+}
+
+static uint32_t seader_replay_sent_tick(SeaderUartBridge* seader_uart, uint8_t* frame) {
+    SeaderReplay* replay = seader_uart->transport_context;
+    return replay->tx_tick[seader_replay_index(replay, frame)];
+}
+
+static size_t seader_replay_receive(SeaderUartBridge* seader_uart) {
+    return seader_uart_ring_count(&seader_uart->rx_ring);
+}
+
+static void seader_replay_reset(SeaderUartBridge* seader_uart) {
+    seader_uart->rx_error = false;
+    seader_uart->rx_ring.tail = seader_uart->rx_ring.head;
+    seader_ccid_resend(&seader_uart->ccid);
+}
+
+static void seader_replay_set_baudrate(SeaderUartBridge* seader_uart, uint32_t baudrate) {
+    // A trace has no line rate, only the bookkeeping follows
+    seader_uart->st.baudrate = baudrate;
+}
+
+const SeaderTransport seader_replay_transport = {
+    .name = "replay",
+    .open = seader_replay_open,
+    .close = seader_replay_close,
+    .acquire = seader_replay_acquire,
+    .send = seader_replay_send,
+    .resend = seader_replay_resend,
+    .release = seader_replay_release,
+    .sent_tick = seader_replay_sent_tick,
+    .receive = seader_replay_receive,
+    .reset = seader_replay_reset,
+    .set_baudrate = seader_replay_set_baudrate,
+};
+
+#endif
@@ -1,25 +1,108 @@
 #include "seader_i.h"
+#include "seader_worker_i.h"
+
+#include <stm32wbxx_ll_dma.h>
+#include <stm32wbxx_ll_lpuart.h>
+#include <stm32wbxx_ll_usart.h>
 
 #define TAG "SeaderUART"
 
+// furi_hal_serial already uses DMA1 channels 6 and 7 for RX
+#define SEADER_UART_TX_DMA DMA1
+
+#define SEADER_UART_ABORT_WAIT_MS (10)
+
+typedef struct {
+    uint32_t channel;
+    FuriHalInterruptId irq;
+    // TCIFx in ISR and CTCIFx in IFCR share a bit position
+    uint32_t tc_flag;
+} SeaderUartTxDma;
+
+// One TX channel per UART so both bridges can run at once, indexed by FuriHalSerialId
+static const SeaderUartTxDma seader_uart_tx_dma[] = {
+    [FuriHalSerialIdUsart] = {LL_DMA_CHANNEL_4, FuriHalInterruptIdDma1Ch4, DMA_ISR_TCIF4},
+    [FuriHalSerialIdLpuart] = {LL_DMA_CHANNEL_5, FuriHalInterruptIdDma1Ch5, DMA_ISR_TCIF5},
+};
+
+// RTS/CTS pairs selected by SeaderUartConfig.flow_pins - 1, 0 disables flow control.
+// Same layout as the usb_uart bridge, minus the pair LPUART itself sits on.
+static const GpioPin* flow_pins[][2] = {
+    {&gpio_ext_pa7, &gpio_ext_pa6}, // 2, 3
+    {&gpio_ext_pb2, &gpio_ext_pc3}, // 6, 7
+};
+
 static void seader_uart_on_irq_rx_dma_cb(
     FuriHalSerialHandle* handle,
     FuriHalSerialRxEvent ev,
     size_t size,
     void* context) {
     SeaderUartBridge* seader_uart = (SeaderUartBridge*)context;
+    SeaderUartRing* ring = &seader_uart->rx_ring;
+    if(ev & (FuriHalSerialRxEventFrameError | FuriHalSerialRxEventNoiseError |
+             FuriHalSerialRxEventOverrunError)) {
+        SeaderUartState* st = &seader_uart->st;
+        if(ev & FuriHalSerialRxEventFrameError) st->frame_errors++;
+        if(ev & FuriHalSerialRxEventNoiseError) st->noise_errors++;
+        if(ev & FuriHalSerialRxEventOverrunError) st->overrun_errors++;
+        seader_uart->rx_error = true;
+        if(!(ev & (FuriHalSerialRxEventData | FuriHalSerialRxEventIdle))) {
+            // Error on its own, wake the worker so it arms the resync timeout in case no idle
+            // event follows
+            furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtRxDone);
+        }
+    }
     if(ev & (FuriHalSerialRxEventData | FuriHalSerialRxEventIdle)) {
-        uint8_t data[FURI_HAL_SERIAL_DMA_BUFFER_SIZE] = {0};
         while(size) {
-            size_t ret = furi_hal_serial_dma_rx(
-                handle,
-                data,
-                (size > FURI_HAL_SERIAL_DMA_BUFFER_SIZE) ? FURI_HAL_SERIAL_DMA_BUFFER_SIZE : size);
-            furi_stream_buffer_send(seader_uart->rx_stream, data, ret, 0);
+            // DMA straight into the ring, at most up to the wrap point or the read cursor
+            size_t head = ring->head & SEADER_UART_RX_RING_MASK;
+            size_t space = SEADER_UART_RX_RING_SIZE - (ring->head - ring->tail);
+            size_t chunk = MIN(size, MIN(space, SEADER_UART_RX_RING_SIZE - head));
+            if(chunk == 0) {
+                // Parser has fallen a whole ring behind, leave the rest in the DMA buffer
+                break;
+            }
+            size_t ret = furi_hal_serial_dma_rx(handle, ring->buf + head, chunk);
+            ring->head += ret;
             size -= ret;
         };
-        furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtRxDone);
+        if(seader_uart->rts_pin && !seader_uart->rts_off &&
+           SEADER_UART_RX_RING_SIZE - seader_uart_ring_count(ring) < SEADER_UART_RTS_OFF_SPACE) {
+            // Ask the SAM to pause before the ring and then the DMA buffer overrun
+            furi_hal_gpio_write(seader_uart->rts_pin, true);
+            seader_uart->rts_off = true;
+            seader_uart->st.rts_throttled++;
+        }
+        if(seader_uart->rx_error) {
+            // Rest of the damaged frame is in once the line is idle, until then keep quiet
+            if(ev & FuriHalSerialRxEventIdle) {
+                furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtRxError);
+            }
+        } else if((ev & FuriHalSerialRxEventIdle) || seader_ccid_frame_ready(ring)) {
+            // Only wake the worker once there is something whole to parse
+            furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtRxDone);
+        }
+    }
+}
+
+size_t seader_uart_ring_count(SeaderUartRing* ring) {
+    return ring->head - ring->tail;
+}
+
+uint8_t seader_uart_ring_peek(SeaderUartRing* ring, size_t offset) {
+    return ring->buf[(ring->tail + offset) & SEADER_UART_RX_RING_MASK];
+}
+
+uint8_t* seader_uart_ring_get(SeaderUartRing* ring, size_t offset, size_t len, uint8_t* scratch) {
+    size_t start = (ring->tail + offset) & SEADER_UART_RX_RING_MASK;
+    if(start + len <= SEADER_UART_RX_RING_SIZE) {
+        return ring->buf + start;
     }
+    // Frame wraps, this is the only case where the bytes are copied
+    size_t first = SEADER_UART_RX_RING_SIZE - start;
+    memcpy(scratch, ring->buf + start, first);
+    memcpy(scratch + first, ring->buf, len - first);
+    return scratch;
 }
 
 void seader_uart_disable(SeaderUartBridge* seader_uart) {
@@ -27,22 +110,146 @@ void seader_uart_disable(SeaderUartBridge* seader_uart) {
     furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtStop);
     furi_thread_join(seader_uart->thread);
     furi_thread_free(seader_uart->thread);
+    seader_ccid_context_free(&seader_uart->ccid);
+    furi_message_queue_free(seader_uart->messages);
+    furi_mutex_free(seader_uart->mq_mutex);
     free(seader_uart);
 }
 
+static FuriThreadId seader_uart_tx_owner(SeaderUartBridge* seader_uart) {
+    FuriThread* owner = seader_uart->tx_thread ? seader_uart->tx_thread : seader_uart->thread;
+    return furi_thread_get_id(owner);
+}
+
+static void seader_uart_tx_dma_isr(void* context) {
+    SeaderUartBridge* seader_uart = (SeaderUartBridge*)context;
+    const SeaderUartTxDma* tx_dma = &seader_uart_tx_dma[seader_uart->cfg.uart_ch];
+    if(!READ_BIT(SEADER_UART_TX_DMA->ISR, tx_dma->tc_flag)) {
+        return;
+    }
+    WRITE_REG(SEADER_UART_TX_DMA->IFCR, tx_dma->tc_flag);
+    LL_DMA_DisableChannel(SEADER_UART_TX_DMA, tx_dma->channel);
+
+    // The last byte may still be in the shift register, that is at most one character time
+    SeaderUartTxDesc* desc = seader_uart->tx_fifo[seader_uart->tx_tail % SEADER_UART_TX_POOL_LEN];
+    seader_uart->tx_tail++;
+    seader_uart->tx_busy = false;
+    desc->done_tick = furi_get_tick();
+    desc->queued = false;
+    if(!desc->held) {
+        furi_semaphore_release(seader_uart->tx_sem);
+    }
+
+    // In single mode the worker kicks the next descriptor when it sees this
+    furi_thread_flags_set(furi_thread_get_id(seader_uart->thread), WorkerEvtSamTxComplete);
+    if(seader_uart->tx_thread) {
+        // Kick the next queued descriptor, if any
+        furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtSamRx);
+    }
+}
+
+static void seader_uart_tx_dma_init(SeaderUartBridge* seader_uart, uint8_t uart_ch) {
+    const SeaderUartTxDma* tx_dma = &seader_uart_tx_dma[uart_ch];
+    LL_DMA_ConfigTransfer(
+        SEADER_UART_TX_DMA,
+        tx_dma->channel,
+        LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT |
+            LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE |
+            LL_DMA_PRIORITY_MEDIUM);
+
+    if(uart_ch == FuriHalSerialIdLpuart) {
+        LL_DMA_SetPeriphRequest(
+            SEADER_UART_TX_DMA, tx_dma->channel, LL_DMAMUX_REQ_LPUART1_TX);
+        LL_DMA_SetPeriphAddress(
+            SEADER_UART_TX_DMA,
+            tx_dma->channel,
+            LL_LPUART_DMA_GetRegAddr(LPUART1, LL_LPUART_DMA_REG_DATA_TRANSMIT));
+        LL_LPUART_EnableDMAReq_TX(LPUART1);
+    } else {
+        LL_DMA_SetPeriphRequest(
+            SEADER_UART_TX_DMA, tx_dma->channel, LL_DMAMUX_REQ_USART1_TX);
+        LL_DMA_SetPeriphAddress(
+            SEADER_UART_TX_DMA,
+            tx_dma->channel,
+            LL_USART_DMA_GetRegAddr(USART1, LL_USART_DMA_REG_DATA_TRANSMIT));
+        LL_USART_EnableDMAReq_TX(USART1);
+    }
+
+    furi_hal_interrupt_set_isr(tx_dma->irq, seader_uart_tx_dma_isr, seader_uart);
+    LL_DMA_EnableIT_TC(SEADER_UART_TX_DMA, tx_dma->channel);
+}
+
+static void seader_uart_tx_dma_deinit(SeaderUartBridge* seader_uart) {
+    const SeaderUartTxDma* tx_dma = &seader_uart_tx_dma[seader_uart->cfg.uart_ch];
+    LL_DMA_DisableIT_TC(SEADER_UART_TX_DMA, tx_dma->channel);
+    LL_DMA_DisableChannel(SEADER_UART_TX_DMA, tx_dma->channel);
+    furi_hal_interrupt_set_isr(tx_dma->irq, NULL, NULL);
+
+    if(seader_uart->cfg.uart_ch == FuriHalSerialIdLpuart) {
+        LL_LPUART_DisableDMAReq_TX(LPUART1);
+    } else {
+        LL_USART_DisableDMAReq_TX(USART1);
+    }
+    seader_uart->tx_busy = false;
+}
+
+static void seader_uart_on_cts_cb(void* context) {
+    SeaderUartBridge* seader_uart = (SeaderUartBridge*)context;
+    if(!furi_hal_gpio_read(seader_uart->cts_pin)) {
+        // SAM is ready again, retry whatever seader_uart_tx_kick held back
+        furi_thread_flags_set(seader_uart_tx_owner(seader_uart), WorkerEvtSamRx);
+    }
+}
+
+static void seader_uart_flow_init(SeaderUartBridge* seader_uart, uint8_t pins) {
+    seader_uart->rts_pin = NULL;
+    seader_uart->cts_pin = NULL;
+    seader_uart->rts_off = false;
+    if(pins == 0) {
+        return;
+    }
+    if(pins > COUNT_OF(flow_pins)) {
+        FURI_LOG_W(TAG, "No flow control pair %d, running without", pins);
+        return;
+    }
+
+    seader_uart->rts_pin = flow_pins[pins - 1][0];
+    seader_uart->cts_pin = flow_pins[pins - 1][1];
+    furi_hal_gpio_init_simple(seader_uart->rts_pin, GpioModeOutputPushPull);
+    furi_hal_gpio_write(seader_uart->rts_pin, false);
+    furi_hal_gpio_init(
+        seader_uart->cts_pin, GpioModeInterruptRiseFall, GpioPullUp, GpioSpeedVeryHigh);
+    furi_hal_gpio_add_int_callback(seader_uart->cts_pin, seader_uart_on_cts_cb, seader_uart);
+}
+
+static void seader_uart_flow_deinit(SeaderUartBridge* seader_uart) {
+    if(!seader_uart->rts_pin) {
+        return;
+    }
+    furi_hal_gpio_remove_int_callback(seader_uart->cts_pin);
+    furi_hal_gpio_init_simple(seader_uart->cts_pin, GpioModeAnalog);
+    furi_hal_gpio_init_simple(seader_uart->rts_pin, GpioModeAnalog);
+    seader_uart->rts_pin = NULL;
+    seader_uart->cts_pin = NULL;
+}
+
 void seader_uart_serial_init(SeaderUartBridge* seader_uart, uint8_t uart_ch) {
     furi_assert(!seader_uart->serial_handle);
 
     seader_uart->serial_handle = furi_hal_serial_control_acquire(uart_ch);
     furi_assert(seader_uart->serial_handle);
 
-    furi_hal_serial_init(seader_uart->serial_handle, 115200);
+    furi_hal_serial_init(seader_uart->serial_handle, SEADER_UART_BAUDRATE_DEFAULT);
+    seader_uart_flow_init(seader_uart, seader_uart->cfg.flow_pins);
     furi_hal_serial_dma_rx_start(
-        seader_uart->serial_handle, seader_uart_on_irq_rx_dma_cb, seader_uart, false);
+        seader_uart->serial_handle, seader_uart_on_irq_rx_dma_cb, seader_uart, true);
+    seader_uart_tx_dma_init(seader_uart, uart_ch);
 }
 
 void seader_uart_serial_deinit(SeaderUartBridge* seader_uart) {
     furi_assert(seader_uart->serial_handle);
+    seader_uart_tx_dma_deinit(seader_uart);
+    seader_uart_flow_deinit(seader_uart);
     furi_hal_serial_deinit(seader_uart->serial_handle);
     furi_hal_serial_control_release(seader_uart->serial_handle);
     seader_uart->serial_handle = NULL;
@@ -51,144 +258,377 @@ void seader_uart_serial_deinit(SeaderUartBridge* seader_uart) {
 void seader_uart_set_baudrate(SeaderUartBridge* seader_uart, uint32_t baudrate) {
     if(baudrate != 0) {
         furi_hal_serial_set_br(seader_uart->serial_handle, baudrate);
+        seader_uart->st.baudrate = baudrate;
     } else {
         FURI_LOG_I(TAG, "No baudrate specified");
     }
 }
 
-size_t seader_uart_process_buffer(Seader* seader, uint8_t* cmd, size_t cmd_len) {
-    SeaderUartBridge* seader_uart = seader->uart;
-    if(cmd_len < 2) {
-        return cmd_len;
+void seader_uart_record_latency(SeaderUartBridge* seader_uart, uint32_t sent_tick) {
+    SeaderUartState* st = &seader_uart->st;
+    uint32_t latency = furi_get_tick() - sent_tick;
+
+    st->apdu_cnt++;
+    st->apdu_latency_last = latency;
+    st->apdu_latency_total += latency;
+    if(latency > st->apdu_latency_max) {
+        st->apdu_latency_max = latency;
+    }
+    FURI_LOG_D(
+        TAG,
+        "APDU latency %ldms (avg %ldms over %ld)",
+        latency,
+        st->apdu_latency_total / st->apdu_cnt,
+        st->apdu_cnt);
+}
+
+static void seader_uart_flow_resume(SeaderUartBridge* seader_uart) {
+    size_t space = SEADER_UART_RX_RING_SIZE - seader_uart_ring_count(&seader_uart->rx_ring);
+    if(seader_uart->rts_off && space >= SEADER_UART_RTS_ON_SPACE) {
+        seader_uart->rts_off = false;
+        furi_hal_gpio_write(seader_uart->rts_pin, false);
     }
+}
+
+void seader_uart_process_buffer(SeaderUartBridge* seader_uart) {
+    SeaderUartRing* ring = &seader_uart->rx_ring;
 
     size_t consumed = 0;
     do {
-        consumed = seader_ccid_process(seader, cmd, cmd_len);
+        if(seader_uart_ring_count(ring) < 2) {
+            break;
+        }
+        consumed = seader_ccid_process(seader_uart->seader, &seader_uart->ccid);
 
         if(consumed > 0) {
-            memset(cmd, 0, consumed);
-            cmd_len -= consumed;
-            if(cmd_len > 0) {
-                memmove(cmd, cmd + consumed, cmd_len);
-            }
+            ring->tail += consumed;
             seader_uart->st.rx_cnt += consumed;
-
-            /*
-            memset(display, 0, SEADER_UART_RX_BUF_SIZE);
-            for (uint8_t i = 0; i < cmd_len; i++) {
-                snprintf(display+(i*2), sizeof(display), "%02x", cmd[i]);
-            }
-            FURI_LOG_I(TAG, "cmd is now %d bytes: %s", cmd_len, display);
-            */
         }
-    } while(consumed > 0 && cmd_len > 0);
-    return cmd_len;
+    } while(consumed > 0);
+
+    seader_uart_flow_resume(seader_uart);
 }
 
-int32_t seader_uart_worker(void* context) {
-    Seader* seader = (Seader*)context;
-    SeaderUartBridge* seader_uart = seader->uart;
-    furi_thread_set_current_priority(FuriThreadPriorityHighest);
+/* Drops whatever the line error damaged and asks for the outstanding answer again */
+void seader_uart_resync(SeaderUartBridge* seader_uart) {
+    SeaderUartRing* ring = &seader_uart->rx_ring;
 
-    memcpy(&seader_uart->cfg, &seader_uart->cfg_new, sizeof(SeaderUartConfig));
+    FURI_LOG_W(TAG, "Line error, flushing %d bytes", seader_uart_ring_count(ring));
+    seader_uart->rx_error = false;
+    ring->tail = ring->head;
+    seader_uart->st.resyncs++;
+    seader_uart_flow_resume(seader_uart);
+    seader_ccid_resend(&seader_uart->ccid);
+}
 
-    seader_uart->rx_stream = furi_stream_buffer_alloc(SEADER_UART_RX_BUF_SIZE, 1);
+/* Called on WorkerEvtCcidAbort, the card went away so the SAM exchange is dropped */
+static void seader_uart_abort(SeaderUartBridge* seader_uart) {
+    // The poller may hold mq_mutex while it waits on this thread for a TX slot, so don't block
+    if(furi_mutex_acquire(seader_uart->mq_mutex, furi_ms_to_ticks(SEADER_UART_ABORT_WAIT_MS)) !=
+       FuriStatusOk) {
+        furi_thread_flags_set(furi_thread_get_current_id(), WorkerEvtCcidAbort);
+        return;
+    }
+    // Anything the SAM queued for the lost card is moot now
+    furi_message_queue_reset(seader_uart->messages);
+    furi_mutex_release(seader_uart->mq_mutex);
+    seader_ccid_Abort(&seader_uart->ccid);
+}
 
-    seader_uart->tx_sem = furi_semaphore_alloc(1, 1);
+int32_t seader_uart_worker(void* context) {
+    SeaderUartBridge* seader_uart = (SeaderUartBridge*)context;
+    Seader* seader = seader_uart->seader;
+    furi_thread_set_current_priority(FuriThreadPriorityHighest);
 
-    seader_uart->tx_thread =
-        furi_thread_alloc_ex("SeaderUartTxWorker", 2 * 1024, seader_uart_tx_thread, seader);
+    memcpy(&seader_uart->cfg, &seader_uart->cfg_new, sizeof(SeaderUartConfig));
 
-    seader_uart_serial_init(seader_uart, seader_uart->cfg.uart_ch);
-    seader_uart_set_baudrate(seader_uart, seader_uart->cfg.baudrate);
+    seader_uart->rx_ring.head = 0;
+    seader_uart->rx_ring.tail = 0;
+    seader_uart->baudrate_state = SeaderUartBaudrateStateIdle;
 
-    furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtSamRx);
+    seader_uart->tx_head = 0;
+    seader_uart->tx_tail = 0;
+    for(size_t i = 0; i < SEADER_UART_TX_POOL_LEN; i++) {
+        seader_uart->tx_pool[i].held = false;
+        seader_uart->tx_pool[i].queued = false;
+    }
+    seader_uart->rx_error = false;
+    seader_uart->tx_sem = furi_semaphore_alloc(SEADER_UART_TX_POOL_LEN, SEADER_UART_TX_POOL_LEN);
+
+    uint32_t wait_events = WORKER_ALL_RX_EVENTS;
+    seader_uart->tx_thread = NULL;
+    if(seader_uart->cfg.thread_mode == SeaderUartThreadModeSplit) {
+        seader_uart->tx_thread =
+            furi_thread_alloc_ex("SeaderUartTxWorker", 1024, seader_uart_tx_thread, seader_uart);
+    } else {
+        wait_events |= WorkerEvtSamRx;
+    }
 
-    furi_thread_start(seader_uart->tx_thread);
+    seader_uart->transport->open(seader_uart);
 
-    uint8_t cmd[SEADER_UART_RX_BUF_SIZE];
-    size_t cmd_len = 0;
+    if(seader_uart->tx_thread) {
+        furi_thread_start(seader_uart->tx_thread);
+    }
 
+    uint32_t timeout = FuriWaitForever;
     while(1) {
-        uint32_t events =
-            furi_thread_flags_wait(WORKER_ALL_RX_EVENTS, FuriFlagWaitAny, FuriWaitForever);
+        uint32_t events = furi_thread_flags_wait(wait_events, FuriFlagWaitAny, timeout);
+        seader_uart->st.rx_wakeups++;
+        if(events == (uint32_t)FuriFlagErrorTimeout) {
+            if(seader_uart->rx_error) {
+                seader_uart->transport->reset(seader_uart);
+            } else if(seader_uart_ring_count(&seader_uart->rx_ring) > 0) {
+                // The rest of the frame never arrived, drop it so the next one can be parsed
+                FURI_LOG_W(
+                    TAG,
+                    "Partial frame timeout, dropping %d bytes",
+                    seader_uart_ring_count(&seader_uart->rx_ring));
+                seader_uart->rx_ring.tail = seader_uart->rx_ring.head;
+                seader_uart_flow_resume(seader_uart);
+            }
+            timeout = FuriWaitForever;
+            if(seader_uart->baudrate_state != SeaderUartBaudrateStateIdle) {
+                seader_ccid_baudrate_fallback(seader, &seader_uart->ccid);
+                if(seader_uart->baudrate_state != SeaderUartBaudrateStateIdle) {
+                    // Reverting takes more round trips, each with its own deadline
+                    timeout = furi_ms_to_ticks(SEADER_UART_BAUDRATE_TIMEOUT_MS);
+                }
+            }
+            continue;
+        }
         furi_check(!(events & FuriFlagError));
         if(events & WorkerEvtStop) {
-            memset(cmd, 0, cmd_len);
-            cmd_len = 0;
+            seader_uart->rx_ring.tail = seader_uart->rx_ring.head;
             break;
         }
-        if(events & (WorkerEvtRxDone | WorkerEvtSamTxComplete)) {
-            size_t len = furi_stream_buffer_receive(
-                seader_uart->rx_stream, seader_uart->rx_buf, SEADER_UART_RX_BUF_SIZE, 0);
-            if(len > 0) {
-                furi_delay_ms(5); //WTF
-
-                /*
-                char display[SEADER_UART_RX_BUF_SIZE * 2 + 1] = {0};
-                for (uint8_t i = 0; i < len; i++) {
-                    snprintf(display+(i*2), sizeof(display), "%02x", seader_uart->rx_buf[i]);
-                }
-                FURI_LOG_I(TAG, "RECV %d bytes: %s", len, display);
-                */
-
-                if(cmd_len + len > SEADER_UART_RX_BUF_SIZE) {
-                    FURI_LOG_I(TAG, "OVERFLOW: %d + %d", cmd_len, len);
-                    memset(cmd, 0, cmd_len);
-                    cmd_len = 0;
-                }
-
-                memcpy(cmd + cmd_len, seader_uart->rx_buf, len);
-                cmd_len += len;
-                cmd_len = seader_uart_process_buffer(seader, cmd, cmd_len);
-            }
+        if(events & WorkerEvtRxError) {
+            seader_uart->transport->reset(seader_uart);
+        }
+        if(events & WorkerEvtCcidTimeout) {
+            seader_ccid_timeout(&seader_uart->ccid);
+        }
+        if(events & WorkerEvtSamIdle) {
+            seader_ccid_idle(&seader_uart->ccid);
+        }
+        if(events & WorkerEvtCcidAbort) {
+            seader_uart_abort(seader_uart);
+        }
+        if(events & WorkerEvtSamSelect) {
+            seader_ccid_select(&seader_uart->ccid);
+        }
+        if(!seader_uart->tx_thread && (events & (WorkerEvtSamRx | WorkerEvtSamTxComplete))) {
+            // Start the next frame before parsing so the wire is not idle meanwhile
+            seader_uart_tx_kick(seader_uart);
+        }
+        if(seader_uart->rx_error) {
+            // Don't parse the damaged frame, wait for WorkerEvtRxError or the timeout
+            timeout = furi_ms_to_ticks(SEADER_UART_FRAME_TIMEOUT_MS);
+        } else if(events & (WorkerEvtRxDone | WorkerEvtSamTxComplete)) {
+            seader_uart->transport->receive(seader_uart);
+            seader_uart_process_buffer(seader_uart);
+            timeout = seader_uart_ring_count(&seader_uart->rx_ring) > 0 ?
+                          furi_ms_to_ticks(SEADER_UART_FRAME_TIMEOUT_MS) :
+                          FuriWaitForever;
+        }
+        if(seader_uart->baudrate_state != SeaderUartBaudrateStateIdle &&
+           timeout == FuriWaitForever) {
+            timeout = furi_ms_to_ticks(SEADER_UART_BAUDRATE_TIMEOUT_MS);
+        }
+    }
+    seader_uart->transport->close(seader_uart);
+
+    SeaderUartState* st = &seader_uart->st;
+    st->rx_stack_free = furi_thread_get_stack_space(furi_thread_get_current_id());
+    if(seader_uart->tx_thread) {
+        st->tx_stack_free =
+            furi_thread_get_stack_space(furi_thread_get_id(seader_uart->tx_thread));
+        furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtTxStop);
+        furi_thread_join(seader_uart->tx_thread);
+        furi_thread_free(seader_uart->tx_thread);
+        seader_uart->tx_thread = NULL;
+    }
+    FURI_LOG_I(
+        TAG,
+        "%ld APDUs, wakeups rx %ld tx %ld, stack free rx %ld tx %ld",
+        st->apdu_cnt,
+        st->rx_wakeups,
+        st->tx_wakeups,
+        st->rx_stack_free,
+        st->tx_stack_free);
+    FURI_LOG_I(
+        TAG,
+        "CCID resends nak %ld timeout %ld line %ld, bad lrc %ld, skipped %ld, stale %ld, lost %ld",
+        st->nak_resends,
+        st->timeout_resends,
+        st->resends,
+        st->lrc_errors,
+        st->skipped_bytes,
+        st->stale_answers,
+        st->requests_lost);
+    FURI_LOG_I(
+        TAG,
+        "CCID time extensions %ld, recovered errors %ld",
+        st->time_extensions,
+        st->recovered_errors);
+    FURI_LOG_I(
+        TAG,
+        "SAM power offs %ld, wakes %ld taking %ldms last %ldms max, %ld over budget",
+        st->sam_power_offs,
+        st->sam_wakes,
+        st->wake_latency_last,
+        st->wake_latency_max,
+        st->wakes_over_budget);
+    FURI_LOG_I(
+        TAG, "%ld NFC responses, %ld heap allocations", st->nfc_rx_cnt, st->nfc_rx_allocs);
+    for(uint8_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+        const SeaderSam* sam = &seader_uart->ccid.sams[slot];
+        if(sam->apdus > 0 || sam->errors > 0) {
+            FURI_LOG_I(
+                TAG,
+                "SAM slot %d: %ld APDUs, busy %ldms, %ld errors",
+                slot,
+                sam->apdus,
+                sam->busy_ms,
+                sam->errors);
         }
     }
-    seader_uart_serial_deinit(seader_uart);
-
-    furi_thread_flags_set(furi_thread_get_id(seader_uart->tx_thread), WorkerEvtTxStop);
-    furi_thread_join(seader_uart->tx_thread);
-    furi_thread_free(seader_uart->tx_thread);
 
-    furi_stream_buffer_free(seader_uart->rx_stream);
     furi_semaphore_free(seader_uart->tx_sem);
     return 0;
 }
 
-SeaderUartBridge* seader_uart_enable(SeaderUartConfig* cfg, Seader* seader) {
+SeaderUartBridge* seader_uart_enable(
+    SeaderUartConfig* cfg,
+    const SeaderTransport* transport,
+    Seader* seader) {
     SeaderUartBridge* seader_uart = malloc(sizeof(SeaderUartBridge));
 
     memcpy(&(seader_uart->cfg_new), cfg, sizeof(SeaderUartConfig));
+    seader_uart->seader = seader;
+    seader_uart->transport = transport;
+    seader_uart->transport_context = NULL;
+
+    seader_ccid_context_init(&seader_uart->ccid, seader_uart);
+    seader_uart->messages = furi_message_queue_alloc(3, sizeof(SeaderAPDU));
+    seader_uart->mq_mutex = furi_mutex_alloc(FuriMutexTypeNormal);
 
     seader_uart->thread =
-        furi_thread_alloc_ex("SeaderUartWorker", 5 * 1024, seader_uart_worker, seader);
+        furi_thread_alloc_ex("SeaderUartWorker", 5 * 1024, seader_uart_worker, seader_uart);
 
     furi_thread_start(seader_uart->thread);
     return seader_uart;
 }
 
+SeaderUartTxDesc* seader_uart_tx_acquire(SeaderUartBridge* seader_uart) {
+    if(!seader_uart->tx_thread &&
+       furi_thread_get_current_id() == furi_thread_get_id(seader_uart->thread)) {
+        // Single mode builder on the worker itself, nobody else would start the DMA. A kick can
+        // find CTS holding TX, so keep kicking until one frees.
+        while(furi_semaphore_acquire(seader_uart->tx_sem, 0) != FuriStatusOk) {
+            seader_uart_tx_kick(seader_uart);
+            if(furi_semaphore_acquire(seader_uart->tx_sem, furi_ms_to_ticks(1)) == FuriStatusOk) {
+                break;
+            }
+        }
+    } else {
+        // Blocks only when every descriptor is still being built, queued or held
+        furi_check(furi_semaphore_acquire(seader_uart->tx_sem, FuriWaitForever) == FuriStatusOk);
+    }
+
+    SeaderUartTxDesc* desc = NULL;
+    FURI_CRITICAL_ENTER();
+    for(size_t i = 0; i < SEADER_UART_TX_POOL_LEN; i++) {
+        if(!seader_uart->tx_pool[i].held && !seader_uart->tx_pool[i].queued) {
+            desc = &seader_uart->tx_pool[i];
+            desc->held = true;
+            break;
+        }
+    }
+    FURI_CRITICAL_EXIT();
+    furi_check(desc);
+
+    // Builders write every byte past the header they send
+    memset(desc->buf, 0, SEADER_CCID_HEADER_LEN);
+    desc->len = 0;
+    return desc;
+}
+
+static void seader_uart_tx_put(SeaderUartBridge* seader_uart, SeaderUartTxDesc* desc) {
+    desc->queued = true;
+    seader_uart->tx_fifo[seader_uart->tx_head % SEADER_UART_TX_POOL_LEN] = desc;
+    seader_uart->tx_head++;
+}
+
+void seader_uart_tx_submit(SeaderUartBridge* seader_uart, SeaderUartTxDesc* desc, size_t len) {
+    if(len == 0) {
+        // Given back unsent
+        seader_uart_tx_release(seader_uart, desc);
+        return;
+    }
+    desc->len = len;
+    desc->done_tick = furi_get_tick();
+    FURI_CRITICAL_ENTER();
+    seader_uart_tx_put(seader_uart, desc);
+    FURI_CRITICAL_EXIT();
+    furi_thread_flags_set(seader_uart_tx_owner(seader_uart), WorkerEvtSamRx);
+}
+
+/* Queues a held descriptor again as is, a no-op while its last submit has not gone out */
+void seader_uart_tx_resend(SeaderUartBridge* seader_uart, SeaderUartTxDesc* desc) {
+    FURI_CRITICAL_ENTER();
+    bool queue = !desc->queued;
+    if(queue) {
+        seader_uart_tx_put(seader_uart, desc);
+    }
+    FURI_CRITICAL_EXIT();
+    if(queue) {
+        furi_thread_flags_set(seader_uart_tx_owner(seader_uart), WorkerEvtSamRx);
+    }
+}
+
+/* Ends the hold from acquire, the descriptor is free once the DMA is done with it too */
+void seader_uart_tx_release(SeaderUartBridge* seader_uart, SeaderUartTxDesc* desc) {
+    FURI_CRITICAL_ENTER();
+    desc->held = false;
+    bool free = !desc->queued;
+    FURI_CRITICAL_EXIT();
+    if(free) {
+        furi_semaphore_release(seader_uart->tx_sem);
+    }
+}
+
+/* Only hands descriptors to the DMA, completion is signalled from seader_uart_tx_dma_isr */
+void seader_uart_tx_kick(SeaderUartBridge* seader_uart) {
+    if(seader_uart->tx_busy || seader_uart->tx_tail == seader_uart->tx_head) {
+        return;
+    }
+    SeaderUartTxDesc* desc = seader_uart->tx_fifo[seader_uart->tx_tail % SEADER_UART_TX_POOL_LEN];
+    if(seader_uart->cts_pin && furi_hal_gpio_read(seader_uart->cts_pin)) {
+        // Frames go out whole, so CTS is only honoured between them
+        seader_uart->st.cts_stalled++;
+        return;
+    }
+
+    seader_uart->tx_busy = true;
+    seader_uart->st.tx_cnt += desc->len;
+    const SeaderUartTxDma* tx_dma = &seader_uart_tx_dma[seader_uart->cfg.uart_ch];
+    LL_DMA_SetMemoryAddress(SEADER_UART_TX_DMA, tx_dma->channel, (uint32_t)desc->buf);
+    LL_DMA_SetDataLength(SEADER_UART_TX_DMA, tx_dma->channel, desc->len);
+    LL_DMA_EnableChannel(SEADER_UART_TX_DMA, tx_dma->channel);
+}
+
 int32_t seader_uart_tx_thread(void* context) {
-    Seader* seader = (Seader*)context;
-    SeaderUartBridge* seader_uart = seader->uart;
+    SeaderUartBridge* seader_uart = (SeaderUartBridge*)context;
 
     furi_thread_set_current_priority(FuriThreadPriorityHighest);
     while(1) {
         uint32_t events =
             furi_thread_flags_wait(WORKER_ALL_TX_EVENTS, FuriFlagWaitAny, FuriWaitForever);
+        seader_uart->st.tx_wakeups++;
         furi_check(!(events & FuriFlagError));
         if(events & WorkerEvtTxStop) break;
         if(events & WorkerEvtSamRx) {
-            if(seader_uart->tx_len > 0) {
-                char display[SEADER_UART_RX_BUF_SIZE * 2 + 1] = {0};
-                for(uint8_t i = 0; i < seader_uart->tx_len; i++) {
-                    snprintf(display + (i * 2), sizeof(display), "%02x", seader_uart->tx_buf[i]);
-                }
-                // FURI_LOG_I(TAG, "SEND %d bytes: %s", seader_uart->tx_len, display);
-                seader_uart->st.tx_cnt += seader_uart->tx_len;
-                furi_hal_serial_tx(
-                    seader_uart->serial_handle, seader_uart->tx_buf, seader_uart->tx_len);
-            }
+            seader_uart_tx_kick(seader_uart);
         }
     }
     return 0;
@@ -206,19 +646,125 @@ void seader_uart_get_state(SeaderUartBridge* seader_uart, SeaderUartState* st) {
     memcpy(st, &(seader_uart->st), sizeof(SeaderUartState));
 }
 
-SeaderUartBridge* seader_uart_alloc(Seader* seader) {
-    SeaderUartConfig cfg = {.uart_ch = FuriHalSerialIdLpuart, .baudrate = 115200};
+SeaderUartBridge*
+    seader_uart_alloc(Seader* seader, FuriHalSerialId uart_ch, const SeaderTransport* transport) {
+    SeaderUartConfig cfg = {
+        .uart_ch = uart_ch,
+        .flow_pins = uart_ch == FuriHalSerialIdLpuart ? SEADER_UART_FLOW_PINS :
+                                                        SEADER_UART2_FLOW_PINS,
+        .baudrate_mode = SEADER_UART_BAUDRATE_MODE,
+        .baudrate = SEADER_UART_BAUDRATE_DEFAULT,
+        .thread_mode = SeaderUartThreadModeSingle,
+        .sam_idle_off_ms = SEADER_SAM_IDLE_OFF_MS};
     SeaderUartState uart_state;
     SeaderUartBridge* seader_uart;
 
-    FURI_LOG_I(TAG, "Enable UART");
-    seader_uart = seader_uart_enable(&cfg, seader);
+    FURI_LOG_I(TAG, "Enable UART %d over %s", uart_ch, transport->name);
+    seader_uart = seader_uart_enable(&cfg, transport, seader);
 
     seader_uart_get_config(seader_uart, &cfg);
     seader_uart_get_state(seader_uart, &uart_state);
     return seader_uart;
 }
 
+static void seader_uart_transport_open(SeaderUartBridge* seader_uart) {
+    seader_uart_serial_init(seader_uart, seader_uart->cfg.uart_ch);
+    seader_uart_set_baudrate(seader_uart, seader_uart->cfg.baudrate);
+}
+
+static uint8_t* seader_uart_transport_acquire(SeaderUartBridge* seader_uart) {
+    return seader_uart_tx_acquire(seader_uart)->buf;
+}
+
+static void seader_uart_transport_send(SeaderUartBridge* seader_uart, uint8_t* frame, size_t len) {
+    // buf is the first member, so the frame is its descriptor
+    seader_uart_tx_submit(seader_uart, (SeaderUartTxDesc*)frame, len);
+}
+
+static void seader_uart_transport_resend(SeaderUartBridge* seader_uart, uint8_t* frame) {
+    seader_uart_tx_resend(seader_uart, (SeaderUartTxDesc*)frame);
+}
+
+static void seader_uart_transport_release(SeaderUartBridge* seader_uart, uint8_t* frame) {
+    seader_uart_tx_release(seader_uart, (SeaderUartTxDesc*)frame);
+}
+
+static uint32_t seader_uart_transport_sent_tick(SeaderUartBridge* seader_uart, uint8_t* frame) {
+    UNUSED(seader_uart);
+    return ((SeaderUartTxDesc*)frame)->done_tick;
+}
+
+static size_t seader_uart_transport_receive(SeaderUartBridge* seader_uart) {
+    // The RX DMA callback already wrote straight into the ring
+    return seader_uart_ring_count(&seader_uart->rx_ring);
+}
+
+static void seader_uart_transport_set_baudrate(SeaderUartBridge* seader_uart, uint32_t baudrate) {
+    // The DMA is done with the last frame, its final byte may still be in the shift register
+    furi_hal_serial_tx_wait_complete(seader_uart->serial_handle);
+    seader_uart_set_baudrate(seader_uart, baudrate);
+}
+
+const SeaderTransport seader_uart_transport = {
+    .name = "uart",
+    .open = seader_uart_transport_open,
+    .close = seader_uart_serial_deinit,
+    .acquire = seader_uart_transport_acquire,
+    .send = seader_uart_transport_send,
+    .resend = seader_uart_transport_resend,
+    .release = seader_uart_transport_release,
+    .sent_tick = seader_uart_transport_sent_tick,
+    .receive = seader_uart_transport_receive,
+    .reset = seader_uart_resync,
+    .set_baudrate = seader_uart_transport_set_baudrate,
+};
+
 void seader_uart_free(SeaderUartBridge* seader_uart) {
     seader_uart_disable(seader_uart);
 }
+
+/* Time a SAM has spent on APDUs, with every error it made counted as SEADER_SAM_ERROR_COST_MS */
+static uint64_t seader_uart_sam_cost(const SeaderSam* sam) {
+    return (uint64_t)sam->busy_ms + (uint64_t)sam->errors * SEADER_SAM_ERROR_COST_MS;
+}
+
+/*
+ * Hands the next card conversation to the least busy SAM over every bridge and slot, one on a
+ * bridge not waiting on an APDU first. Ties go to the LPUART bridge and the lower slot.
+ */
+SeaderUartBridge* seader_uart_select_idle(Seader* seader) {
+    SeaderUartBridge* bridges[] = {seader->uart, seader->uart2};
+    SeaderUartBridge* best = NULL;
+    uint8_t best_slot = 0;
+    uint64_t best_cost = UINT64_MAX;
+    bool best_idle = false;
+
+    for(size_t i = 0; i < COUNT_OF(bridges); i++) {
+        SeaderUartBridge* seader_uart = bridges[i];
+        if(!seader_uart || !seader_uart->ccid.has_sam) {
+            continue;
+        }
+        bool idle = !seader_uart->ccid.apdu_pending;
+        for(uint8_t slot = 0; slot < SEADER_CCID_SLOTS; slot++) {
+            const SeaderSam* sam = &seader_uart->ccid.sams[slot];
+            if(!sam->present) {
+                continue;
+            }
+            uint64_t cost = seader_uart_sam_cost(sam);
+            if((idle && !best_idle) || (idle == best_idle && cost < best_cost)) {
+                best = seader_uart;
+                best_slot = slot;
+                best_cost = cost;
+                best_idle = idle;
+            }
+        }
+    }
+    if(!best) {
+        return seader->uart;
+    }
+    if(best_idle) {
+        seader_ccid_select_slot(&best->ccid, best_slot);
+    }
+    // Every SAM is busy, queue behind the cheapest one on the slot it is already using
+    return best;
+}
@@ -3,17 +3,33 @@
 #include "seader_bridge.h"
 
 int32_t seader_uart_tx_thread(void* context);
+void seader_uart_tx_kick(SeaderUartBridge* seader_uart);
+SeaderUartTxDesc* seader_uart_tx_acquire(SeaderUartBridge* seader_uart);
+void seader_uart_tx_submit(SeaderUartBridge* seader_uart, SeaderUartTxDesc* desc, size_t len);
+void seader_uart_tx_resend(SeaderUartBridge* seader_uart, SeaderUartTxDesc* desc);
+void seader_uart_tx_release(SeaderUartBridge* seader_uart, SeaderUartTxDesc* desc);
 void seader_uart_on_irq_cb(uint8_t data, void* context);
 void seader_uart_serial_init(SeaderUartBridge* seader_uart, uint8_t uart_ch);
 void seader_uart_serial_deinit(SeaderUartBridge* seader_uart);
 void seader_uart_set_baudrate(SeaderUartBridge* seader_uart, uint32_t baudrate);
 int32_t seader_uart_worker(void* context);
+void seader_uart_record_latency(SeaderUartBridge* seader_uart, uint32_t sent_tick);
+void seader_uart_process_buffer(SeaderUartBridge* seader_uart);
+void seader_uart_resync(SeaderUartBridge* seader_uart);
 
-SeaderUartBridge* seader_uart_enable(SeaderUartConfig* cfg, Seader* seader);
+size_t seader_uart_ring_count(SeaderUartRing* ring);
+uint8_t seader_uart_ring_peek(SeaderUartRing* ring, size_t offset);
+uint8_t* seader_uart_ring_get(SeaderUartRing* ring, size_t offset, size_t len, uint8_t* scratch);
+
+SeaderUartBridge* seader_uart_enable(
+    SeaderUartConfig* cfg,
+    const SeaderTransport* transport,
+    Seader* seader);
 void seader_uart_disable(SeaderUartBridge* seader_uart);
-void seader_uart_set_config(SeaderUartBridge* seader_uart, SeaderUartConfig* cfg);
 void seader_uart_get_config(SeaderUartBridge* seader_uart, SeaderUartConfig* cfg);
 void seader_uart_get_state(SeaderUartBridge* seader_uart, SeaderUartState* st);
 
-SeaderUartBridge* seader_uart_alloc();
+SeaderUartBridge*
+    seader_uart_alloc(Seader* seader, FuriHalSerialId uart_ch, const SeaderTransport* transport);
 void seader_uart_free(SeaderUartBridge* seader_uart);
+SeaderUartBridge* seader_uart_select_idle(Seader* seader);